@@ -41,8 +41,16 @@ enum CrowTag {
 
 // Table flags
 // DECORATE: this table defines context / decorator fields that apply to tables in this block
+// FRAMED: each TROW is followed by varint byte length of the row
 
 #define TABLE_FLAG_DECORATE  (uint8_t)0x10
+#define TABLE_FLAG_FRAMED    (uint8_t)0x20
+
+// TBLOCK is followed by the byte length of the block, as 32-bit little
+// endian so it can be filled in once the block is complete.  A block
+// starts with TTABLE and the field headers, so it decodes on its own.
+
+#define BLOCK_LEN_SIZE       4
 
 typedef DynType CrowType;
 
@@ -92,9 +100,11 @@ namespace crow {
 
 } // namespace crow
 
+#include "crow/crow_sink.hpp"
 #include "crow/crow_encode.hpp"
 #include "crow/crow_decode.hpp"
 
+#include "crow/private/crow_sink_impl.hpp"
 #include "crow/private/crow_encode_impl.hpp"
 #include "crow/private/crow_decode_impl.hpp"
 
@@ -0,0 +1,268 @@
+#ifndef _CROW_COLUMNAR_DECODER_HPP_
+#define _CROW_COLUMNAR_DECODER_HPP_
+
+#include "../crow.hpp"
+
+namespace crow {
+
+  /*
+   * Decoded values of one field, one entry per row.  Only the vector
+   * matching the field type is used:
+   *
+   *   TINT8               i8
+   *   TUINT8              u8
+   *   TINT16, TINT32      i32
+   *   TUINT16, TUINT32    u32
+   *   TINT64              i64
+   *   TUINT64             u64
+   *   TFLOAT32, TFLOAT64  f64
+   *   TSTRING, TBYTES     offsets, data
+   *
+   * Value of row i of a string column is data[offsets[i]..offsets[i+1]).
+   * Rows without a value hold 0 or an empty string, and have their bit
+   * in validity cleared.
+   */
+  struct DecodedColumn {
+    SPCFieldInfo          field;
+    size_t                numRows;
+    std::vector<uint64_t> validity;   // bit per row, set if row has value
+
+    std::vector<int8_t>   i8;
+    std::vector<uint8_t>  u8;
+    std::vector<int32_t>  i32;
+    std::vector<uint32_t> u32;
+    std::vector<int64_t>  i64;
+    std::vector<uint64_t> u64;
+    std::vector<double>   f64;
+    std::vector<uint32_t> offsets;    // numRows + 1 entries
+    std::vector<uint8_t>  data;
+
+    DecodedColumn() : field(), numRows(0), validity(), i8(), u8(), i32(), u32(), i64(), u64(), f64(),
+      offsets(1, 0), data() {}
+
+    bool isValid(size_t row) const { return (validity[row >> 6] >> (row & 63)) & 1; }
+
+    ByteView str(size_t row) const {
+      return ByteView(data.data() + offsets[row], offsets[row + 1] - offsets[row]);
+    }
+  };
+
+  /*
+   * Appends decoded values into contiguous per-column vectors, instead
+   * of a map per row.  Use with DecoderImpl::decode(), which calls it
+   * without virtual dispatch:
+   *
+   *   ColumnarDecoderListener cols;
+   *   DecoderImpl dec(data, len);
+   *   dec.decode(cols);
+   *   const DecodedColumn *pAge = cols.column(1);
+   *
+   * Struct fields are split into columns too.  Rows of tables with the
+   * same fields, such as the blocks of one table (see
+   * Encoder::setBlockPolicy), are appended to the same columns.  When a
+   * table defines a field index differently, rows of earlier tables are
+   * dropped.
+   */
+  class ColumnarDecoderListener : public StaticDecoderListener {
+  public:
+    ColumnarDecoderListener() : _columns(), _numRows(0), _tableStartRow(0) {}
+
+    void onField(const SPCFieldInfo &field, int8_t value, uint8_t flags) { _append(field, &DecodedColumn::i8, value); }
+    void onField(const SPCFieldInfo &field, uint8_t value, uint8_t flags) { _append(field, &DecodedColumn::u8, value); }
+    void onField(const SPCFieldInfo &field, int32_t value, uint8_t flags) { _append(field, &DecodedColumn::i32, value); }
+    void onField(const SPCFieldInfo &field, uint32_t value, uint8_t flags) { _append(field, &DecodedColumn::u32, value); }
+    void onField(const SPCFieldInfo &field, int64_t value, uint8_t flags) { _append(field, &DecodedColumn::i64, value); }
+    void onField(const SPCFieldInfo &field, uint64_t value, uint8_t flags) { _append(field, &DecodedColumn::u64, value); }
+    void onField(const SPCFieldInfo &field, double value, uint8_t flags) { _append(field, &DecodedColumn::f64, value); }
+    void onField(const SPCFieldInfo &field, const ByteView &value, uint8_t flags) {
+      _appendBytes(field, value.data(), value.size());
+    }
+
+    void onRowStart() { _numRows++; }
+
+    void onRowEnd(bool isHeaderRow, const uint8_t* pEncodedRowStart, size_t length) {
+      for (auto &col : _columns) {
+        if (col.field && col.numRows < _numRows) { _padTo(col, _numRows); }
+      }
+    }
+
+    int onStruct(const uint8_t *data, size_t datalen, const std::vector<SPCFieldInfo> &structFields) {
+      const uint8_t *p = data;
+      for (const SPCFieldInfo &field : structFields) {
+        _appendRaw(field, p);
+        p += field->structFieldLength;
+      }
+      return 0;
+    }
+
+    void onTableStart(uint8_t flags) {
+      _tableStartRow = _numRows;
+    }
+
+    size_t numRows() const { return _numRows; }
+
+    /*
+     * returns column of field index, nullptr if field has no values.
+     */
+    const DecodedColumn* column(size_t index) const {
+      if (index >= _columns.size() || !_columns[index].field) { return nullptr; }
+      return &_columns[index];
+    }
+
+    const std::vector<DecodedColumn>& columns() const { return _columns; }
+
+  private:
+
+    DecodedColumn* _column(const SPCFieldInfo &field) {
+      if (_numRows == 0) { return nullptr; }  // value before first row
+      if (field->index >= _columns.size()) { _columns.resize(field->index + 1); }
+      DecodedColumn *pCol = &_columns[field->index];
+      if (pCol->field && pCol->field != field && !_isSameField(*pCol->field, *field)) {
+        _dropRows(_tableStartRow);
+        pCol = &_columns[field->index];
+        *pCol = DecodedColumn();
+      }
+      DecodedColumn &col = *pCol;
+      if (!col.field) { col.field = field; }
+      if (col.numRows >= _numRows) { return nullptr; }  // already has value for row
+      if (col.numRows + 1 < _numRows) { _padTo(col, _numRows - 1); }
+      return &col;
+    }
+
+    static bool _isSameField(const FieldInfo &a, const FieldInfo &b) {
+      return (a.typeId == b.typeId && a.id == b.id && a.name == b.name &&
+              a.structFieldLength == b.structFieldLength &&
+              (a.schema ? a.schema->id : 0) == (b.schema ? b.schema->id : 0));
+    }
+
+    /*
+     * Remove the first n rows of all columns, when a table with other
+     * fields starts.
+     */
+    void _dropRows(size_t n) {
+      if (n == 0) { return; }
+      for (auto &col : _columns) {
+        if (!col.field) { continue; }
+        size_t keep = (col.numRows > n ? col.numRows - n : 0);
+        size_t drop = col.numRows - keep;
+        switch (col.field->typeId) {
+          case TINT8: col.i8.erase(col.i8.begin(), col.i8.begin() + drop); break;
+          case TUINT8: col.u8.erase(col.u8.begin(), col.u8.begin() + drop); break;
+          case TINT16:
+          case TINT32: col.i32.erase(col.i32.begin(), col.i32.begin() + drop); break;
+          case TUINT16:
+          case TUINT32: col.u32.erase(col.u32.begin(), col.u32.begin() + drop); break;
+          case TINT64: col.i64.erase(col.i64.begin(), col.i64.begin() + drop); break;
+          case TUINT64: col.u64.erase(col.u64.begin(), col.u64.begin() + drop); break;
+          case TFLOAT32:
+          case TFLOAT64: col.f64.erase(col.f64.begin(), col.f64.begin() + drop); break;
+          case TSTRING:
+          case TBYTES: {
+            uint32_t base = col.offsets[drop];
+            col.data.erase(col.data.begin(), col.data.begin() + base);
+            col.offsets.erase(col.offsets.begin(), col.offsets.begin() + drop);
+            for (auto &off : col.offsets) { off -= base; }
+            break;
+          }
+          default: break;
+        }
+
+        std::vector<uint64_t> validity;
+        validity.swap(col.validity);
+        col.numRows = 0;
+        for (size_t row = drop; row < drop + keep; row++) {
+          _setValid(col, (validity[row >> 6] >> (row & 63)) & 1);
+        }
+      }
+      _numRows -= n;
+      _tableStartRow = 0;
+    }
+
+    static void _setValid(DecodedColumn &col, bool valid) {
+      size_t row = col.numRows++;
+      if ((row & 63) == 0) { col.validity.push_back(0); }
+      if (valid) { col.validity.back() |= (1ULL << (row & 63)); }
+    }
+
+    template<typename T>
+    void _append(const SPCFieldInfo &field, std::vector<T> DecodedColumn::*member, T value) {
+      DecodedColumn *pCol = _column(field);
+      if (pCol == nullptr) { return; }
+      (pCol->*member).push_back(value);
+      _setValid(*pCol, true);
+    }
+
+    void _appendBytes(const SPCFieldInfo &field, const uint8_t *src, size_t len) {
+      DecodedColumn *pCol = _column(field);
+      if (pCol == nullptr) { return; }
+      pCol->data.insert(pCol->data.end(), src, src + len);
+      pCol->offsets.push_back((uint32_t)pCol->data.size());
+      _setValid(*pCol, true);
+    }
+
+    /*
+     * append struct field value, stored in native byte order.
+     */
+    void _appendRaw(const SPCFieldInfo &field, const uint8_t *p) {
+      switch (field->typeId) {
+        case TINT8: _append(field, &DecodedColumn::i8, (int8_t)*p); break;
+        case TUINT8: _append(field, &DecodedColumn::u8, *p); break;
+        case TINT16: _append(field, &DecodedColumn::i32, (int32_t)_load<int16_t>(p)); break;
+        case TUINT16: _append(field, &DecodedColumn::u32, (uint32_t)_load<uint16_t>(p)); break;
+        case TINT32: _append(field, &DecodedColumn::i32, _load<int32_t>(p)); break;
+        case TUINT32: _append(field, &DecodedColumn::u32, _load<uint32_t>(p)); break;
+        case TINT64: _append(field, &DecodedColumn::i64, _load<int64_t>(p)); break;
+        case TUINT64: _append(field, &DecodedColumn::u64, _load<uint64_t>(p)); break;
+        case TFLOAT32: _append(field, &DecodedColumn::f64, (double)_load<float>(p)); break;
+        case TFLOAT64: _append(field, &DecodedColumn::f64, _load<double>(p)); break;
+        case TSTRING: {
+          // fixed length char array, may be NUL terminated
+          const void *pNul = memchr(p, 0, field->structFieldLength);
+          size_t len = (pNul == nullptr ? field->structFieldLength : (size_t)((const uint8_t *)pNul - p));
+          _appendBytes(field, p, len);
+          break;
+        }
+        case TBYTES: _appendBytes(field, p, field->structFieldLength); break;
+        default: break;
+      }
+    }
+
+    template<typename T>
+    static T _load(const uint8_t *p) {
+      T value;
+      memcpy(&value, p, sizeof(value));
+      return value;
+    }
+
+    /*
+     * add empty, invalid entries until column has numRows rows.
+     */
+    static void _padTo(DecodedColumn &col, size_t numRows) {
+      while (col.numRows < numRows) {
+        switch (col.field->typeId) {
+          case TINT8: col.i8.push_back(0); break;
+          case TUINT8: col.u8.push_back(0); break;
+          case TINT16:
+          case TINT32: col.i32.push_back(0); break;
+          case TUINT16:
+          case TUINT32: col.u32.push_back(0); break;
+          case TINT64: col.i64.push_back(0); break;
+          case TUINT64: col.u64.push_back(0); break;
+          case TFLOAT32:
+          case TFLOAT64: col.f64.push_back(0); break;
+          case TSTRING:
+          case TBYTES: col.offsets.push_back(col.offsets.back()); break;
+          default: break;
+        }
+        _setValid(col, false);
+      }
+    }
+
+    std::vector<DecodedColumn> _columns;   // indexed by field index
+    size_t                     _numRows;
+    size_t                     _tableStartRow;  // first row of current table
+  };
+
+} // namespace crow
+
+#endif // _CROW_COLUMNAR_DECODER_HPP_
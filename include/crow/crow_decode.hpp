@@ -2,6 +2,7 @@
 #define _CROW_DECODE_HPP_
 
 #include <stdint.h>
+#include <string.h>
 #include <string>
 #include <vector>
 #include <map>
@@ -10,6 +11,38 @@ namespace crow {
 
   const int RV_SKIP_VARIABLE_FIELDS = 2;
 
+  /*
+   * Pointer and length of a TSTRING or TBYTES value, pointing into the
+   * buffer being decoded, so no copy is made.  A view is only guaranteed
+   * valid until the onField() call receiving it returns.  For decoders
+   * over a caller's buffer, it stays valid as long as that buffer.
+   * Use str() or bytes() to keep a copy.
+   */
+  class ByteView {
+  public:
+    ByteView(const uint8_t *ptr, size_t len) : _ptr(ptr), _len(len) {}
+
+    const uint8_t* data() const { return _ptr; }
+    const char* chars() const { return reinterpret_cast<const char*>(_ptr); }
+    size_t size() const { return _len; }
+    bool empty() const { return _len == 0; }
+
+    std::string str() const { return std::string(chars(), _len); }
+    std::vector<uint8_t> bytes() const { return std::vector<uint8_t>(_ptr, _ptr + _len); }
+
+    bool operator==(const ByteView &rhs) const {
+      return _len == rhs._len && (_len == 0 || memcmp(_ptr, rhs._ptr, _len) == 0);
+    }
+    bool operator!=(const ByteView &rhs) const { return !(*this == rhs); }
+    bool operator==(const std::string &rhs) const {
+      return _len == rhs.size() && (_len == 0 || memcmp(_ptr, rhs.data(), _len) == 0);
+    }
+
+  private:
+    const uint8_t *_ptr;
+    size_t         _len;
+  };
+
   class DecoderListener {
   public:
     virtual void onField(SPCFieldInfo, int8_t value, uint8_t flags) {}
@@ -21,6 +54,17 @@ namespace crow {
     virtual void onField(SPCFieldInfo, double value, uint8_t flags) {}
     virtual void onField(SPCFieldInfo, const std::string &value, uint8_t flags) {}
     virtual void onField(SPCFieldInfo, const std::vector<uint8_t> value, uint8_t flags) {}
+    /*
+     * Receives TSTRING and TBYTES values without a copy.  The default
+     * copies the value and calls the std::string or vector overload.
+     */
+    virtual void onField(SPCFieldInfo field, const ByteView &value, uint8_t flags) {
+      if (field->typeId == TBYTES) {
+        onField(field, value.bytes(), flags);
+      } else {
+        onField(field, value.str(), flags);
+      }
+    }
     virtual void onRowStart() {}
     /*
      * Notifies when a row is finished.
@@ -37,6 +81,102 @@ namespace crow {
     virtual void onTableStart(uint8_t flags) {}
   };
 
+  /*
+   * Listener that receives fields by reference, rather than as shared
+   * pointers, so no reference counts are touched per decoded value.
+   * field.index is the dense column index within the current table.
+   * References stay valid until the next table starts.
+   */
+  class FieldDecoderListener {
+  public:
+    virtual void onField(const FieldInfo &field, int8_t value, uint8_t flags) {}
+    virtual void onField(const FieldInfo &field, uint8_t value, uint8_t flags) {}
+    virtual void onField(const FieldInfo &field, int32_t value, uint8_t flags) {}
+    virtual void onField(const FieldInfo &field, uint32_t value, uint8_t flags) {}
+    virtual void onField(const FieldInfo &field, int64_t value, uint8_t flags) {}
+    virtual void onField(const FieldInfo &field, uint64_t value, uint8_t flags) {}
+    virtual void onField(const FieldInfo &field, double value, uint8_t flags) {}
+    virtual void onField(const FieldInfo &field, const std::string &value, uint8_t flags) {}
+    virtual void onField(const FieldInfo &field, const std::vector<uint8_t> &value, uint8_t flags) {}
+    virtual void onField(const FieldInfo &field, const ByteView &value, uint8_t flags) {
+      if (field.typeId == TBYTES) {
+        onField(field, value.bytes(), flags);
+      } else {
+        onField(field, value.str(), flags);
+      }
+    }
+    virtual void onRowStart() {}
+    virtual void onRowEnd(bool isHeaderRow, const uint8_t* pEncodedRowStart, size_t length) {}
+    virtual int onStruct(const uint8_t *data, size_t datalen, const std::vector<SPCFieldInfo> &structFields) { return 0;}
+    virtual void onTableStart(uint8_t flags) {}
+    virtual ~FieldDecoderListener() {}
+  };
+
+  /*
+   * Base for listeners passed to DecoderImpl::decode<L>().  Methods are
+   * not virtual; the decoder calls them on the listener's own type, so
+   * trivial handlers inline into the decode loop.  Derived listeners
+   * define the methods they need and should add
+   * `using StaticDecoderListener::onField;` so overloads they do not
+   * define are not hidden.
+   * TSTRING and TBYTES values are only delivered as ByteView.
+   */
+  class StaticDecoderListener {
+  public:
+    void onField(const SPCFieldInfo&, int8_t value, uint8_t flags) {}
+    void onField(const SPCFieldInfo&, uint8_t value, uint8_t flags) {}
+    void onField(const SPCFieldInfo&, int32_t value, uint8_t flags) {}
+    void onField(const SPCFieldInfo&, uint32_t value, uint8_t flags) {}
+    void onField(const SPCFieldInfo&, int64_t value, uint8_t flags) {}
+    void onField(const SPCFieldInfo&, uint64_t value, uint8_t flags) {}
+    void onField(const SPCFieldInfo&, double value, uint8_t flags) {}
+    void onField(const SPCFieldInfo&, const ByteView &value, uint8_t flags) {}
+    void onRowStart() {}
+    void onRowEnd(bool isHeaderRow, const uint8_t* pEncodedRowStart, size_t length) {}
+    int onStruct(const uint8_t *data, size_t datalen, const std::vector<SPCFieldInfo> &structFields) { return 0; }
+    void onTableStart(uint8_t flags) {}
+  };
+
+  /*
+   * Condition on the value of a field, see Decoder::addPredicate().
+   * The field is matched by id if fieldId is set, otherwise by name.
+   * Values are converted to the field type.
+   */
+  struct Predicate {
+    enum Op {
+      EQUALS,     // values[0]
+      RANGE,      // values[0] <= value <= values[1]
+      IN_SET      // any of values
+    };
+
+    uint32_t            fieldId;
+    std::string         fieldName;
+    Op                  op;
+    std::vector<DynVal> values;
+
+    Predicate(uint32_t id, const std::string &name, Op o, const std::vector<DynVal> &vals) :
+      fieldId(id), fieldName(name), op(o), values(vals) {}
+
+    static Predicate Equals(uint32_t fieldId, DynVal value) {
+      return Predicate(fieldId, std::string(), EQUALS, std::vector<DynVal>(1, value));
+    }
+    static Predicate Equals(const std::string &fieldName, DynVal value) {
+      return Predicate(0, fieldName, EQUALS, std::vector<DynVal>(1, value));
+    }
+    static Predicate Range(uint32_t fieldId, DynVal minValue, DynVal maxValue) {
+      return Predicate(fieldId, std::string(), RANGE, std::vector<DynVal>({minValue, maxValue}));
+    }
+    static Predicate Range(const std::string &fieldName, DynVal minValue, DynVal maxValue) {
+      return Predicate(0, fieldName, RANGE, std::vector<DynVal>({minValue, maxValue}));
+    }
+    static Predicate InSet(uint32_t fieldId, const std::vector<DynVal> &values) {
+      return Predicate(fieldId, std::string(), IN_SET, values);
+    }
+    static Predicate InSet(const std::string &fieldName, const std::vector<DynVal> &values) {
+      return Predicate(0, fieldName, IN_SET, values);
+    }
+  };
+
 #define DECODER_MODE_SKIP (1 << 1)
 
   class Decoder {
@@ -53,6 +193,13 @@ namespace crow {
      */
     virtual uint32_t decode(DecoderListener &listener, uint64_t setId = 0) = 0;
 
+    /**
+     * @brief Same as decodeRow(DecoderListener&) and decode(DecoderListener&),
+     * without shared_ptr copies per field.
+     */
+    virtual bool decodeRow(FieldDecoderListener &listener) = 0;
+    virtual uint32_t decode(FieldDecoderListener &listener, uint64_t setId = 0) = 0;
+
     virtual ~Decoder() {}
 
     /**
@@ -78,6 +225,36 @@ namespace crow {
 
     virtual std::vector<SPCFieldInfo> getFields() = 0;
 
+    /**
+     * @brief Only deliver values of fields with these ids, or names.
+     * Values of other fields are skipped over, without a listener call.
+     * Struct data is still passed whole to onStruct().  The variable
+     * section of struct rows is skipped if no variable field is selected.
+     * An empty list selects all fields.
+     */
+    virtual void setProjection(const std::vector<uint32_t> &fieldIds) = 0;
+    virtual void setProjection(const std::vector<std::string> &fieldNames) = 0;
+
+    /**
+     * @brief Only deliver rows matching all predicates.  Rows are
+     * checked when they start, and rejected rows are skipped without
+     * any listener call.  A row without a value for the field does not
+     * match.
+     * @returns 0 on success, -1 if predicate is not valid.
+     */
+    virtual int addPredicate(const Predicate &predicate) = 0;
+    virtual void clearPredicates() = 0;
+
+    /**
+     * @brief Skip the next count rows without listener calls.  Values of
+     * a row already started are dropped too.  Rows of tables with
+     * TABLE_FLAG_FRAMED are jumped over by their length, so skipping
+     * does not touch row data.  Rows rejected by predicates are not
+     * counted.
+     * @returns number of rows skipped, less than count at end of data.
+     */
+    virtual uint32_t skipRows(uint32_t count) = 0;
+
     virtual void setModeFlags(int flags) = 0;
   };
 
@@ -8,12 +8,113 @@
 
 namespace crow {
 
+  /*
+   * Dense handle for a field of the current table, returned by
+   * Encoder::addField().  Handles are invalidated by startTable().
+   */
+  typedef int FieldHandle;
+
+  /*
+   * Controls when endRow(fd) and endRow(sink) write buffered rows.
+   * Rows are written once any of the non-zero limits is reached.
+   * maxLatencyMs is checked when a row ends, so producers that can go
+   * idle should call sync() to bound the delay.
+   * While the sink is not ready, rows are buffered instead, up to
+   * maxBufferedBytes; past that the encoder writes anyway, and waits
+   * for the sink (see Sink::ready()).  0 buffers without limit.
+   * The default writes every row.
+   */
+  struct FlushPolicy {
+    static const size_t DEFAULT_MAX_BUFFERED = 64 * 1024 * 1024;
+
+    uint32_t maxRows;          // flush after this many rows
+    size_t   maxBytes;         // flush once this many bytes are buffered
+    uint32_t maxLatencyMs;     // flush once oldest buffered row is this old
+    size_t   maxBufferedBytes; // flush even if sink is not ready
+
+    FlushPolicy(uint32_t rows = 1, size_t bytes = 0, uint32_t latencyMs = 0,
+                size_t maxBuffered = DEFAULT_MAX_BUFFERED) :
+      maxRows(rows), maxBytes(bytes), maxLatencyMs(latencyMs), maxBufferedBytes(maxBuffered) {}
+  };
+
+  /*
+   * Cuts output into blocks of at least maxBytes bytes or maxRows rows,
+   * whichever comes first.  Each block starts with TBLOCK, its length
+   * and the table and field headers, so it decodes without the data
+   * before it.  Blocks end at row boundaries.  The default is no blocks.
+   */
+  struct BlockPolicy {
+    uint32_t maxRows;        // close block after this many rows
+    size_t   maxBytes;       // close block once it is this large
+
+    BlockPolicy(uint32_t rows = 0, size_t bytes = 0) : maxRows(rows), maxBytes(bytes) {}
+
+    bool enabled() const { return maxRows > 0 || maxBytes > 0; }
+  };
+
   class Encoder {
   public:
 
     virtual int put(const SPFieldDef field, DynVal value) = 0;
     virtual int put(const DynMap &obj) = 0;
 
+    /*
+     * Typed puts.  The value is written directly to the row buffer,
+     * without boxing it in a DynVal.  If the value type does not match
+     * field->typeId, it is converted to the field type.
+     */
+    virtual int put(const SPFieldDef field, bool value) = 0;
+    virtual int put(const SPFieldDef field, int8_t value) = 0;
+    virtual int put(const SPFieldDef field, uint8_t value) = 0;
+    virtual int put(const SPFieldDef field, int16_t value) = 0;
+    virtual int put(const SPFieldDef field, uint16_t value) = 0;
+    virtual int put(const SPFieldDef field, int32_t value) = 0;
+    virtual int put(const SPFieldDef field, uint32_t value) = 0;
+    virtual int put(const SPFieldDef field, int64_t value) = 0;
+    virtual int put(const SPFieldDef field, uint64_t value) = 0;
+    virtual int put(const SPFieldDef field, float value) = 0;
+    virtual int put(const SPFieldDef field, double value) = 0;
+
+    /*
+     * Length-delimited values for TSTRING and TBYTES fields.
+     * Bytes are copied once, straight from the caller's buffer.
+     */
+    virtual int put(const SPFieldDef field, const char *str) = 0;
+    virtual int put(const SPFieldDef field, const char *str, size_t len) = 0;
+    virtual int put(const SPFieldDef field, const std::string &str) = 0;
+    virtual int put(const SPFieldDef field, const uint8_t *bytes, size_t len) = 0;
+    virtual int put(const SPFieldDef field, const Bytes &bytes) = 0;
+
+    /**
+     * @brief define field in current table and return its handle.
+     * The field header is written if not already defined.  Puts using
+     * the handle index directly into the field list, without a lookup.
+     * @returns handle >= 0 on success, < 0 on error.
+     */
+    virtual FieldHandle addField(const SPFieldDef field) = 0;
+
+    /*
+     * Same as the SPFieldDef puts above, using a handle from addField().
+     * @returns 0 on success, -1 if handle is not valid.
+     */
+    virtual int put(FieldHandle field, DynVal value) = 0;
+    virtual int put(FieldHandle field, bool value) = 0;
+    virtual int put(FieldHandle field, int8_t value) = 0;
+    virtual int put(FieldHandle field, uint8_t value) = 0;
+    virtual int put(FieldHandle field, int16_t value) = 0;
+    virtual int put(FieldHandle field, uint16_t value) = 0;
+    virtual int put(FieldHandle field, int32_t value) = 0;
+    virtual int put(FieldHandle field, uint32_t value) = 0;
+    virtual int put(FieldHandle field, int64_t value) = 0;
+    virtual int put(FieldHandle field, uint64_t value) = 0;
+    virtual int put(FieldHandle field, float value) = 0;
+    virtual int put(FieldHandle field, double value) = 0;
+    virtual int put(FieldHandle field, const char *str) = 0;
+    virtual int put(FieldHandle field, const char *str, size_t len) = 0;
+    virtual int put(FieldHandle field, const std::string &str) = 0;
+    virtual int put(FieldHandle field, const uint8_t *bytes, size_t len) = 0;
+    virtual int put(FieldHandle field, const Bytes &bytes) = 0;
+
     virtual int struct_hdr(const SPFieldDef field, int fixedLength = 0) = 0;
 
     /**
@@ -23,23 +124,80 @@ namespace crow {
      */
     virtual int put_struct(const void *data, size_t struct_size) = 0;
 
+    /**
+     * @brief encode nrows rows from column arrays.
+     * columns[i] holds nrows values for fields[i], in the native type of
+     * the field: int32_t for TINT32, double for TFLOAT64, and so on.
+     * TSTRING and TBYTES columns are arrays of std::string.
+     * Any open row is ended first, and each row is ended after its
+     * values, so output matches calling put() per cell and startRow().
+     * @returns 0 on success, -1 if sizes, handles or columns are invalid,
+     * or the table has struct fields.
+     */
+    virtual int put_columns(const std::vector<FieldHandle> &fields,
+                            const std::vector<const void *> &columns, size_t nrows) = 0;
+
+    /*
+     * Start a new table, with TABLE_FLAG_XX flags.  With
+     * TABLE_FLAG_FRAMED, each row carries its byte length, so readers
+     * can skip rows without decoding them.
+     */
     virtual void startTable(int flags = 0) = 0;
 
     virtual void startRow() = 0;
 
     /*
-     * Call at end of row.  If fd > 0, will flush buffers to file.
+     * Call at end of row.  If fd > 0, buffers are flushed to file
+     * according to the flush policy.
      */
     virtual void endRow(int fd = 0) = 0;
 
+    /*
+     * Call at end of row.  Buffers are flushed to sink according to the
+     * flush policy.
+     */
+    virtual void endRow(Sink &sink) = 0;
+
+    virtual void setFlushPolicy(const FlushPolicy &policy) = 0;
+
+    /*
+     * With blocks enabled, endRow() writes each block once it is
+     * complete, and the flush policy is not used.  flush() and sync()
+     * close the open block, so set the policy before the first put.
+     */
+    virtual void setBlockPolicy(const BlockPolicy &policy) = 0;
+
+    /*
+     * Write all buffered rows now, regardless of flush policy.
+     */
+    virtual void sync(int fd) = 0;
+    virtual void sync(Sink &sink) = 0;
+
     /*
      * Call at end of data to flush encoding buffers.
      */
     virtual void flush(bool headersOnly=false) const = 0;
     virtual void flushfd(int fd, bool headersOnly=false) = 0;
 
+    /*
+     * Flush encoding buffers to sink.  Completed output is removed
+     * from encoder buffers, whether or not the sink succeeds.
+     */
+    virtual void flush(Sink &sink, bool headersOnly=false) = 0;
+
+    /**
+     * returns 0 if no error, otherwise code from errno.h of the last
+     * failed sink write.
+     */
+    virtual int getErrCode() const = 0;
+
     virtual const uint8_t* data() const = 0;
     virtual size_t size() const = 0;
+
+    /*
+     * Reset to initial state: discards buffered output, fields and
+     * struct definition.  Buffer capacity and flush policy are kept.
+     */
     virtual void clear() = 0;
 
     virtual ~Encoder() {}
@@ -0,0 +1,227 @@
+#ifndef _CROW_PARALLEL_DECODER_HPP_
+#define _CROW_PARALLEL_DECODER_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "../crow.hpp"
+
+namespace crow {
+
+  /*
+   * Location of a block, including its TBLOCK tag and length.
+   */
+  struct BlockRange {
+    size_t offset;
+    size_t length;
+
+    BlockRange(size_t off, size_t len) : offset(off), length(len) {}
+  };
+
+  /*
+   * Lists the blocks of encoded data, by reading only the block lengths.
+   * Data that does not start with TBLOCK is listed as one block.
+   * returns 0 on success, EINVAL if a block runs past end of data.
+   */
+  inline int FindBlocks(const uint8_t *pEncData, size_t encLength, std::vector<BlockRange> &blocks) {
+    blocks.clear();
+    if (encLength == 0) { return 0; }
+    if (pEncData[0] != TBLOCK) {
+      blocks.push_back(BlockRange(0, encLength));
+      return 0;
+    }
+
+    size_t offset = 0;
+    while (offset < encLength) {
+      if (pEncData[offset] != TBLOCK || encLength - offset < 1 + BLOCK_LEN_SIZE) {
+        return EINVAL;
+      }
+      const uint8_t *p = pEncData + offset + 1;
+      size_t blockLen = 0;
+      for (int i=0; i < BLOCK_LEN_SIZE; i++) {
+        blockLen |= ((size_t)p[i]) << (8 * i);
+      }
+      size_t total = 1 + BLOCK_LEN_SIZE + blockLen;
+      if (total > encLength - offset) {
+        return EINVAL;
+      }
+      blocks.push_back(BlockRange(offset, total));
+      offset += total;
+    }
+    return 0;
+  }
+
+  /*
+   * Decodes block framed data (see Encoder::setBlockPolicy) on several
+   * threads, each running its own DecoderImpl over whole blocks.  Idle
+   * threads take the next undecoded block, so uneven blocks balance
+   * out.
+   *
+   *   ParallelDecoder pdec(data, len);
+   *   std::vector<ColumnarDecoderListener> perThread(4);
+   *   pdec.decode(perThread);
+   *
+   * or, to see blocks in order:
+   *
+   *   pdec.decodeOrdered<GenericDecoderListener>([](size_t block, GenericDecoderListener &dl) { ... });
+   *
+   * Listeners may be static (StaticDecoderListener) or virtual.
+   */
+  class ParallelDecoder {
+  public:
+    ParallelDecoder(const uint8_t *pEncData, size_t encLength) :
+      _data(pEncData), _blocks(), _setup(), _err(0) {
+      _err = FindBlocks(pEncData, encLength, _blocks);
+    }
+
+    /*
+     * Called on each block decoder before decoding, to set projection
+     * or predicates.
+     */
+    void setDecoderSetup(std::function<void(Decoder&)> fn) { _setup = fn; }
+
+    size_t numBlocks() const { return _blocks.size(); }
+    const std::vector<BlockRange>& blocks() const { return _blocks; }
+
+    /*
+     * returns 0 if no error, otherwise code from errno.h
+     */
+    int getErrCode() const { return _err; }
+
+    /*
+     * Decode with one thread per listener.  Listener i gets the blocks
+     * decoded by thread i, in no particular order.
+     * returns number of rows decoded.
+     */
+    template<typename L>
+    uint32_t decode(std::vector<L> &listeners) {
+      if (_err != 0 || listeners.empty()) { return 0; }
+
+      std::atomic<size_t> next(0);
+      std::atomic<uint32_t> numRows(0);
+      size_t numThreads = std::min(listeners.size(), _blocks.size());
+
+      auto work = [&](L &listener) {
+        size_t i;
+        while ((i = next.fetch_add(1)) < _blocks.size()) {
+          numRows += _decodeBlock(i, listener);
+        }
+      };
+
+      std::vector<std::thread> threads;
+      for (size_t t=1; t < numThreads; t++) {
+        threads.push_back(std::thread(work, std::ref(listeners[t])));
+      }
+      work(listeners[0]);
+      for (auto &th : threads) { th.join(); }
+
+      return numRows;
+    }
+
+    /*
+     * Decode each block into a new L, and pass them to deliver(blockIndex,
+     * listener) in block order, on the calling thread.  At most
+     * 2 x numThreads decoded blocks are held waiting for delivery.  If
+     * deliver throws, decoding stops and the exception is rethrown once
+     * the threads have finished.
+     * returns number of rows decoded.
+     */
+    template<typename L, typename F>
+    uint32_t decodeOrdered(F deliver, unsigned numThreads = 0) {
+      if (_err != 0) { return 0; }
+      if (numThreads == 0) { numThreads = std::max(1u, std::thread::hardware_concurrency()); }
+      size_t n = _blocks.size();
+      size_t window = 2 * (size_t)numThreads;
+
+      std::mutex mutex;
+      std::condition_variable cond;
+      std::vector<std::unique_ptr<L>> results(n);
+      size_t next = 0;
+      size_t delivered = 0;
+      uint32_t numRows = 0;
+
+      auto work = [&]() {
+        while (true) {
+          size_t i;
+          {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&]() { return next >= n || next < delivered + window; });
+            if (next >= n) { return; }
+            i = next++;
+          }
+          std::unique_ptr<L> pListener(new L());
+          uint32_t rows = _decodeBlock(i, *pListener);
+          {
+            std::unique_lock<std::mutex> lock(mutex);
+            numRows += rows;
+            results[i] = std::move(pListener);
+          }
+          cond.notify_all();
+        }
+      };
+
+      std::vector<std::thread> threads;
+      for (unsigned t=0; t < numThreads && t < n; t++) {
+        threads.push_back(std::thread(work));
+      }
+
+      for (size_t i=0; i < n; i++) {
+        std::unique_ptr<L> pListener;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          cond.wait(lock, [&]() { return results[i] != nullptr; });
+          pListener = std::move(results[i]);
+        }
+        try {
+          deliver(i, *pListener);
+        } catch (...) {
+          {
+            std::unique_lock<std::mutex> lock(mutex);
+            next = n;   // workers take no more blocks
+          }
+          cond.notify_all();
+          for (auto &th : threads) { th.join(); }
+          throw;
+        }
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          delivered++;
+        }
+        cond.notify_all();
+      }
+      for (auto &th : threads) { th.join(); }
+
+      return numRows;
+    }
+
+  private:
+
+    template<typename L>
+    uint32_t _decodeBlock(size_t i, L &listener) {
+      DecoderImpl dec(_data + _blocks[i].offset, _blocks[i].length);
+      if (_setup) { _setup(dec); }
+      try {
+        uint32_t numRows = dec.decode(listener);
+        int err = dec.getErrCode();
+        if (err != 0) { _err = err; }
+        return numRows;
+      } catch (std::exception *e) {
+        // invalid field definition
+        delete e;
+        _err = EINVAL;
+        return 0;
+      }
+    }
+
+    const uint8_t          *_data;
+    std::vector<BlockRange> _blocks;
+    std::function<void(Decoder&)> _setup;
+    std::atomic<int>        _err;
+  };
+
+} // namespace crow
+
+#endif // _CROW_PARALLEL_DECODER_HPP_
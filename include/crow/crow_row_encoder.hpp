@@ -0,0 +1,222 @@
+#ifndef _CROW_ROW_ENCODER_HPP_
+#define _CROW_ROW_ENCODER_HPP_
+
+#include "../crow.hpp"
+
+namespace crow {
+
+  /*
+   * Column type of a RowEncoder.  Each specialization knows the C type
+   * of its values and how to encode one, so rows are written without
+   * DynVal or a switch on the type.
+   */
+  template<CrowType T> struct Field;
+
+  template<> struct Field<TINT8> {
+    typedef int8_t param_type;
+    static const CrowType typeId = TINT8;
+    static size_t maxSize(param_type) { return 1; }
+    static uint8_t* encode(uint8_t *p, param_type v) { *p++ = (uint8_t)v; return p; }
+  };
+
+  template<> struct Field<TUINT8> {
+    typedef uint8_t param_type;
+    static const CrowType typeId = TUINT8;
+    static size_t maxSize(param_type) { return 1; }
+    static uint8_t* encode(uint8_t *p, param_type v) { *p++ = v; return p; }
+  };
+
+  template<> struct Field<TINT16> {
+    typedef int16_t param_type;
+    static const CrowType typeId = TINT16;
+    static size_t maxSize(param_type) { return MAX_VARINT_LEN; }
+    static uint8_t* encode(uint8_t *p, param_type v) { return p + encodeVarInt(ZigZagEncode32(v), p); }
+  };
+
+  template<> struct Field<TUINT16> {
+    typedef uint16_t param_type;
+    static const CrowType typeId = TUINT16;
+    static size_t maxSize(param_type) { return MAX_VARINT_LEN; }
+    static uint8_t* encode(uint8_t *p, param_type v) { return p + encodeVarInt(v, p); }
+  };
+
+  template<> struct Field<TINT32> {
+    typedef int32_t param_type;
+    static const CrowType typeId = TINT32;
+    static size_t maxSize(param_type) { return MAX_VARINT_LEN; }
+    static uint8_t* encode(uint8_t *p, param_type v) { return p + encodeVarInt(ZigZagEncode32(v), p); }
+  };
+
+  template<> struct Field<TUINT32> {
+    typedef uint32_t param_type;
+    static const CrowType typeId = TUINT32;
+    static size_t maxSize(param_type) { return MAX_VARINT_LEN; }
+    static uint8_t* encode(uint8_t *p, param_type v) { return p + encodeVarInt(v, p); }
+  };
+
+  template<> struct Field<TINT64> {
+    typedef int64_t param_type;
+    static const CrowType typeId = TINT64;
+    static size_t maxSize(param_type) { return MAX_VARINT_LEN; }
+    static uint8_t* encode(uint8_t *p, param_type v) { return p + encodeVarInt(ZigZagEncode64(v), p); }
+  };
+
+  template<> struct Field<TUINT64> {
+    typedef uint64_t param_type;
+    static const CrowType typeId = TUINT64;
+    static size_t maxSize(param_type) { return MAX_VARINT_LEN; }
+    static uint8_t* encode(uint8_t *p, param_type v) { return p + encodeVarInt(v, p); }
+  };
+
+  template<> struct Field<TFLOAT32> {
+    typedef float param_type;
+    static const CrowType typeId = TFLOAT32;
+    static size_t maxSize(param_type) { return sizeof(float); }
+    static uint8_t* encode(uint8_t *p, param_type v) { memcpy(p, &v, sizeof(v)); return p + sizeof(v); }
+  };
+
+  template<> struct Field<TFLOAT64> {
+    typedef double param_type;
+    static const CrowType typeId = TFLOAT64;
+    static size_t maxSize(param_type) { return sizeof(double); }
+    static uint8_t* encode(uint8_t *p, param_type v) { memcpy(p, &v, sizeof(v)); return p + sizeof(v); }
+  };
+
+  template<> struct Field<TSTRING> {
+    typedef const std::string& param_type;
+    static const CrowType typeId = TSTRING;
+    static size_t maxSize(param_type v) { return MAX_VARINT_LEN + v.size(); }
+    static uint8_t* encode(uint8_t *p, param_type v) {
+      p += encodeVarInt(v.size(), p);
+      memcpy(p, v.data(), v.size());
+      return p + v.size();
+    }
+  };
+
+  template<> struct Field<TBYTES> {
+    typedef const Bytes& param_type;
+    static const CrowType typeId = TBYTES;
+    static size_t maxSize(param_type v) { return MAX_VARINT_LEN + v.size(); }
+    static uint8_t* encode(uint8_t *p, param_type v) {
+      p += encodeVarInt(v.size(), p);
+      if (!v.empty()) { memcpy(p, v.data(), v.size()); }
+      return p + v.size();
+    }
+  };
+
+  /*
+   * Writes the cells of a row, one column type per level of recursion.
+   * Index is the field index of the first column.
+   */
+  template<uint8_t Index, typename... Fs> struct RowWriter;
+
+  template<uint8_t Index> struct RowWriter<Index> {
+    static size_t maxSize() { return 0; }
+    static uint8_t* write(uint8_t *p) { return p; }
+  };
+
+  template<uint8_t Index, typename F, typename... Fs> struct RowWriter<Index, F, Fs...> {
+    typedef RowWriter<Index + 1, Fs...> Next;
+
+    static size_t maxSize(typename F::param_type v, typename Fs::param_type... rest) {
+      return 1 + F::maxSize(v) + Next::maxSize(rest...);
+    }
+    static uint8_t* write(uint8_t *p, typename F::param_type v, typename Fs::param_type... rest) {
+      *p++ = Index | (uint8_t)0x80;
+      p = F::encode(p, v);
+      return Next::write(p, rest...);
+    }
+  };
+
+  template<typename F> struct FieldDefArg { typedef const SPFieldDef& type; };
+
+  /*
+   * Encoder for tables whose columns are known at compile time.
+   *
+   *   RowEncoder<Field<TUINT16>, Field<TSTRING>> enc(fage, fname);
+   *   enc.putRow(23, "bob");
+   *
+   * Field headers are encoded once, at construction, and written ahead
+   * of the first row.  Every row sets all columns, as if each were put
+   * to an EncoderImpl, so the output decodes with DecoderImpl.
+   * Struct columns are not supported.
+   */
+  template<typename... Fs>
+  class RowEncoder {
+    static_assert(sizeof...(Fs) > 0, "RowEncoder needs at least one field");
+    static_assert(sizeof...(Fs) < 128, "RowEncoder field index must fit in 7 bits");
+  public:
+    RowEncoder(typename FieldDefArg<Fs>::type... fieldDefs) : _stack(4096), _hdr(), _hdrWritten(false), _err(0) {
+      std::vector<SPFieldDef> defs { fieldDefs... };
+      const CrowType typeIds[] = { Fs::typeId... };
+
+      // let EncoderImpl encode the headers, so they match exactly
+
+      EncoderImpl enc(256);
+      for (size_t i=0; i < defs.size(); i++) {
+        if (!defs[i] || defs[i]->typeId != typeIds[i]) {
+          throw new std::invalid_argument("RowEncoder field type does not match definition");
+        }
+        if (enc.addField(defs[i]) != (FieldHandle)i) {
+          throw new std::invalid_argument("RowEncoder field defined more than once");
+        }
+      }
+      const uint8_t *p = enc.data();
+      _hdr.assign(p, p + enc.size());
+    }
+
+    /*
+     * Append a row with a value for each column, in column order.
+     */
+    void putRow(typename Fs::param_type... values) {
+      if (!_hdrWritten) {
+        memcpy(_stack.Push(_hdr.size()), _hdr.data(), _hdr.size());
+        _hdrWritten = true;
+      }
+      _stack.Reserve(1 + RowWriter<0, Fs...>::maxSize(values...));
+      uint8_t *start = _stack.Top();
+      uint8_t *p = start;
+      *p++ = TROW;
+      p = RowWriter<0, Fs...>::write(p, values...);
+      _stack.PushUnsafe((size_t)(p - start));
+    }
+
+    /*
+     * Write buffered output to sink and clear it.
+     * returns 0 on success, otherwise code from errno.h
+     */
+    int flush(Sink &sink) {
+      struct iovec iov;
+      iov.iov_base = _stack.Bottom();
+      iov.iov_len = _stack.GetSize();
+      int rv = (iov.iov_len > 0 ? sink.write(&iov, 1) : 0);
+      if (rv != 0) { _err = rv; }
+      _stack.Clear();
+      return rv;
+    }
+
+    int getErrCode() const { return _err; }
+
+    const uint8_t* data() const { return _stack.Bottom(); }
+    size_t size() const { return _stack.GetSize(); }
+
+    /*
+     * Discard buffered output.  Headers are written again ahead of the
+     * next row, so the following output stands alone.
+     */
+    void clear() {
+      _stack.Clear();
+      _hdrWritten = false;
+      _err = 0;
+    }
+
+  private:
+    Stack                _stack;
+    std::vector<uint8_t> _hdr;
+    bool                 _hdrWritten;
+    int                  _err;
+  };
+
+} // namespace crow
+
+#endif // _CROW_ROW_ENCODER_HPP_
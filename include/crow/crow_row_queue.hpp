@@ -0,0 +1,189 @@
+#ifndef _CROW_ROW_QUEUE_HPP_
+#define _CROW_ROW_QUEUE_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "crow_row_encoder.hpp"
+
+namespace crow {
+
+  /*
+   * Bounded queue of encoded rows from many producer threads, drained
+   * by one encoder thread into a sink.
+   *
+   *   RowQueue<Field<TSTRING>, Field<TINT32>> queue(sink, NAME, AGE);
+   *   queue.putRow("bob", 23);     // any thread
+   *   ...
+   *   queue.close();               // once producers are done
+   *
+   * Producers encode the row into a slot of a ring, with the same code
+   * as RowEncoder, and publish it with one compare-and-swap and one
+   * store.  No locks are taken.  The encoder thread appends each row
+   * to an EncoderImpl, and writes to the sink once 64KB are buffered
+   * or the queue is empty.  Rows of one producer keep their order.
+   */
+  template<typename... Fs>
+  class RowQueue {
+  public:
+    static const size_t DEFAULT_CAPACITY = 4096;
+    static const size_t DEFAULT_SLOT_SIZE = 256;
+
+    /*
+     * capacity is rounded up to a power of 2.  Rows that encode to more
+     * than slotSize bytes are rejected.
+     */
+    RowQueue(Sink &sink, size_t capacity, size_t slotSize, typename FieldDefArg<Fs>::type... fieldDefs) :
+      _capacity(_roundUp(capacity)), _mask(_capacity - 1), _slotSize(slotSize),
+      _slots(new Slot[_capacity]), _data(new uint8_t[_capacity * slotSize]),
+      _tail(0), _head(0), _closed(false), _sink(sink), _enc(65536), _thread() {
+
+      std::vector<SPFieldDef> defs { fieldDefs... };
+      const CrowType typeIds[] = { Fs::typeId... };
+      for (size_t i=0; i < defs.size(); i++) {
+        if (!defs[i] || defs[i]->typeId != typeIds[i]) {
+          throw new std::invalid_argument("RowQueue field type does not match definition");
+        }
+        if (_enc.addField(defs[i]) != (FieldHandle)i) {
+          throw new std::invalid_argument("RowQueue field defined more than once");
+        }
+      }
+      _enc.setFlushPolicy(FlushPolicy(0, 65536));
+
+      for (size_t i=0; i < _capacity; i++) {
+        _slots[i].seq.store(i, std::memory_order_relaxed);
+      }
+      _thread = std::thread(&RowQueue::_run, this);
+    }
+
+    RowQueue(Sink &sink, typename FieldDefArg<Fs>::type... fieldDefs) :
+      RowQueue(sink, DEFAULT_CAPACITY, DEFAULT_SLOT_SIZE, fieldDefs...) {}
+
+    ~RowQueue() { close(); }
+
+    /*
+     * Queue a row, without waiting.
+     * returns 0 on success, EAGAIN if queue is full, EMSGSIZE if row is
+     * larger than a slot, EPIPE if closed.
+     */
+    int tryPutRow(typename Fs::param_type... values) {
+      if (_closed.load(std::memory_order_relaxed)) { return EPIPE; }
+      if (RowWriter<0, Fs...>::maxSize(values...) > _slotSize) { return EMSGSIZE; }
+
+      size_t pos = _tail.load(std::memory_order_relaxed);
+      Slot *pSlot;
+      while (true) {
+        pSlot = &_slots[pos & _mask];
+        size_t seq = pSlot->seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+          if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) { break; }
+        } else if (diff < 0) {
+          return EAGAIN;   // consumer has not freed slot yet
+        } else {
+          pos = _tail.load(std::memory_order_relaxed);
+        }
+      }
+
+      uint8_t *start = _data.get() + (pos & _mask) * _slotSize;
+      uint8_t *end = RowWriter<0, Fs...>::write(start, values...);
+      pSlot->len = (uint32_t)(end - start);
+      pSlot->seq.store(pos + 1, std::memory_order_release);
+      return 0;
+    }
+
+    /*
+     * Queue a row, yielding while the queue is full.
+     * returns 0 on success, EMSGSIZE if row is larger than a slot,
+     * EPIPE if closed.
+     */
+    int putRow(typename Fs::param_type... values) {
+      int rv;
+      while ((rv = tryPutRow(values...)) == EAGAIN) {
+        std::this_thread::yield();
+      }
+      return rv;
+    }
+
+    /*
+     * Encode queued rows, flush to sink and stop encoder thread.  Call
+     * once producers are done; rows queued during close may be lost.
+     */
+    void close() {
+      if (_closed.exchange(true)) { return; }
+      _thread.join();
+    }
+
+    size_t capacity() const { return _capacity; }
+
+    /*
+     * returns 0 if no error, otherwise code from errno.h of the last
+     * failed sink write.  Valid after close().
+     */
+    int getErrCode() const { return _enc.getErrCode(); }
+
+  private:
+
+    struct Slot {
+      std::atomic<size_t> seq;   // pos when free, pos + 1 when row is ready
+      uint32_t            len;
+    };
+
+    static size_t _roundUp(size_t n) {
+      size_t c = 2;
+      while (c < n) { c <<= 1; }
+      return c;
+    }
+
+    /*
+     * Encoder thread.  Spins briefly when the queue runs dry, then
+     * writes what it has and backs off.
+     */
+    void _run() {
+      size_t idle = 0;
+      while (true) {
+        Slot &slot = _slots[_head & _mask];
+        if (slot.seq.load(std::memory_order_acquire) == _head + 1) {
+          _enc.putEncodedRow(_data.get() + (_head & _mask) * _slotSize, slot.len);
+          _enc.endRow(_sink);
+          slot.seq.store(_head + _capacity, std::memory_order_release);
+          _head++;
+          idle = 0;
+          continue;
+        }
+
+        if (idle == 0) {
+          _enc.sync(_sink);
+        }
+        if (_closed.load(std::memory_order_acquire) &&
+            slot.seq.load(std::memory_order_acquire) != _head + 1) {
+          break;
+        }
+        if (++idle < 64) {
+          std::this_thread::yield();
+        } else {
+          std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+      }
+      _enc.sync(_sink);
+    }
+
+    const size_t                 _capacity;
+    const size_t                 _mask;
+    const size_t                 _slotSize;
+    std::unique_ptr<Slot[]>      _slots;
+    std::unique_ptr<uint8_t[]>   _data;
+    uint8_t                      _pad1[64];
+    std::atomic<size_t>          _tail;       // next pos for producers
+    uint8_t                      _pad2[64];   // keep producers off encoder thread's line
+    size_t                       _head;       // next pos for encoder thread
+    std::atomic<bool>            _closed;
+    Sink                        &_sink;
+    EncoderImpl                  _enc;
+    std::thread                  _thread;
+  };
+
+} // namespace crow
+
+#endif // _CROW_ROW_QUEUE_HPP_
@@ -0,0 +1,46 @@
+#ifndef _CROW_SINK_HPP_
+#define _CROW_SINK_HPP_
+
+#include <stdint.h>
+#include <sys/uio.h>
+
+namespace crow {
+
+  class Stack;
+
+  /*
+   * Destination for flushed encoder output.  The encoder hands over
+   * the header, struct and variable sections of its buffers as a list
+   * of segments, so they can be written without consolidating them.
+   */
+  class Sink {
+  public:
+
+    /**
+     * @brief write all bytes of segments, in order.
+     * @returns 0 on success, otherwise code from errno.h
+     */
+    virtual int write(const struct iovec *iov, int iovcnt) = 0;
+
+    /**
+     * @brief take a completed output buffer, leaving an empty one in its place.
+     * Lets the encoder hand over its buffer without copying it.
+     * @returns false if not supported, in which case write() is used.
+     */
+    virtual bool swap(Stack &buffer) { return false; }
+
+    /**
+     * @returns false if sink is backed up.  The encoder keeps buffering
+     * rows instead of flushing while the sink is not ready, until
+     * FlushPolicy::maxBufferedBytes are buffered.  It then writes
+     * anyway, so write() or swap() should block until there is room,
+     * as AsyncSink does, or return an error.
+     */
+    virtual bool ready() const { return true; }
+
+    virtual ~Sink() {}
+  };
+
+} // namespace crow
+
+#endif // _CROW_SINK_HPP_
@@ -1,12 +1,19 @@
 #ifndef _CROW_DECODE_IMPL_HPP_
 #define _CROW_DECODE_IMPL_HPP_
 
+#include <algorithm>
 #include <map>
+#include <type_traits>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "../../crow.hpp"
 #include "stack.hpp"
 #include "protobuf_wire_format.h"
+#include "varint.hpp"
 #include "../../crow/crow_test_decoder.hpp"
 
 #define NONE_LEFT(PTR) (PTR >= _end)
@@ -53,6 +60,35 @@ namespace crow {
 
   };
 
+  template<typename L>
+  struct IsVirtualListener {
+    static const bool value = std::is_base_of<DecoderListener, L>::value ||
+                              std::is_base_of<FieldDecoderListener, L>::value;
+  };
+
+  /*
+   * Passes fields of the static decode loop to a FieldDecoderListener
+   * by reference.
+   */
+  class FieldListenerAdapter {
+  public:
+    FieldListenerAdapter(FieldDecoderListener &listener) : _listener(listener) {}
+
+    template<typename T>
+    void onField(const SPCFieldInfo &field, const T &value, uint8_t flags) { _listener.onField(*field, value, flags); }
+    void onRowStart() { _listener.onRowStart(); }
+    void onRowEnd(bool isHeaderRow, const uint8_t* pEncodedRowStart, size_t length) {
+      _listener.onRowEnd(isHeaderRow, pEncodedRowStart, length);
+    }
+    int onStruct(const uint8_t *data, size_t datalen, const std::vector<SPCFieldInfo> &structFields) {
+      return _listener.onStruct(data, datalen, structFields);
+    }
+    void onTableStart(uint8_t flags) { _listener.onTableStart(flags); }
+
+  private:
+    FieldDecoderListener &_listener;
+  };
+
   /*
    * Implementation of Decoder
    */
@@ -65,7 +101,9 @@ namespace crow {
       _errOffset(0L), _setId(0L), _mapSets(),
       _byteCount(encLength), _flags(0), _numRows(0),
       _structFields(), _structLen(0), _rowStartPos(0), _modeFlags(0),
-      _tableFlags(0)
+      _tableFlags(0), _projIds(), _projNames(), _hasProjection(false), _selected(), _numVarSelected(0),
+      _predicates(), _compiled(), _fieldPreds(), _numUnbound(0), _rowRejected(false),
+      _windowEnd(SIZE_MAX)
       //, _isDecoratorTable(false),
     //_decoratorFields(), _decoratorListener(), _decoratorValues()
     {
@@ -84,22 +122,66 @@ namespace crow {
      * decode
      */
     uint32_t decode(DecoderListener &listener, uint64_t setId = 0L) override {
+      return _decode(listener, setId);
+    }
+
+    bool decodeRow(DecoderListener &listener) override {
+      return _decodeRow(listener);
+    }
+
+    uint32_t decode(FieldDecoderListener &listener, uint64_t setId = 0L) override {
+      FieldListenerAdapter adapter(listener);
+      return _decode(adapter, setId);
+    }
+
+    bool decodeRow(FieldDecoderListener &listener) override {
+      FieldListenerAdapter adapter(listener);
+      return _decodeRow(adapter);
+    }
+
+    /*
+     * Static dispatch variants of decode() and decodeRow().  Listener
+     * methods are called on the concrete type L, so they can be inlined
+     * into the decode loop.  See StaticDecoderListener for the methods
+     * L must provide.  Listeners derived from DecoderListener or
+     * FieldDecoderListener use the virtual overloads.
+     */
+    template<typename L>
+    typename std::enable_if<!IsVirtualListener<L>::value, uint32_t>::type
+    decode(L &listener, uint64_t setId = 0L) {
+      return _decode(listener, setId);
+    }
+
+    template<typename L>
+    typename std::enable_if<!IsVirtualListener<L>::value, bool>::type
+    decodeRow(L &listener) {
+      return _decodeRow(listener);
+    }
+
+    template<typename L>
+    uint32_t _decode(L &listener, uint64_t setId) {
       _setId = setId;
 
+      // _numRows counts rows of current table, blocks reset it
+
+      uint32_t n = 0;
       _numRows = 0;
       _rowStartPos = _data.getOffset();
-      while(false == decodeRow(listener)) {
+      while(false == _decodeRow(listener)) {
           _numRows++;
+          n++;
       }
 
-      if (_numRows > 0) {
+      if (_numRows > 0 && !_rowRejected) {
         listener.onRowEnd(false, _data.start + _rowStartPos, (size_t)(_data.getOffset() - _rowStartPos));
       }
 
-      return _numRows;
+      return n;
     }
 
-    bool decodeRow(DecoderListener &listener) override {
+    template<typename L>
+    bool _decodeRow(L &listener) {
+      if (BRANCH_UNLIKELY_(_data.getOffset() >= _windowEnd)) { _onWindow(); }
       if (_modeFlags & DECODER_MODE_SKIP) {
         return _doSkipRow(listener, _data);
       } else {
@@ -107,11 +189,12 @@ namespace crow {
       }
     }
 
-    bool _doDecodeRow(DecoderListener &listener, PData &data) {
+    template<typename L>
+    bool _doDecodeRow(L &listener, PData &data) {
       while (true) {
 
         uint8_t tagbyte;
-        if (data.empty()) { _markError(ENOSPC, data); return true; }
+        if (data.empty()) { return true; }  // end of data
         tagbyte = *data.ptr++;
         bool isIndex = (tagbyte & (uint8_t)0x80) != 0;
         uint8_t tagid = tagbyte & 0x0F;
@@ -122,49 +205,27 @@ namespace crow {
           if (index >= _fields.size()) {
             _markError(EINVAL, data); return true;
           }
-          SPFieldInfo pField = _fields[index];
-
-          if (_decodeValue(pField, data, listener)) {
+          if (!_selected[index]) {
+            _skipValue(_fields[index]->typeId, data);
+            continue;
+          }
+          if (_decodeValue(_constFields[index], data, listener)) {
             break;
           }
 
         } else if (tagid == TROW) {
-          listener.onRowEnd((_numRows == 0), _data.start + _rowStartPos, (size_t)(_data.getOffset() - _rowStartPos - 1));
-
-          _flags = (tagbyte >> 4) & 0x07;
-          _rowStartPos = data.getOffset();
-          { listener.onRowStart(); }
-          if (_structLen > 0) {
-            auto structPtr = data.ptr;
-            if (data.remaining() < _structLen) {
-              throw new std::runtime_error("no more data, trying to read struct");
-            }
-            data.ptr += _structLen;
-            // read struct
-            size_t varlen = 0;
-            if (_fields.size() > _structFields.size()) {
-              // read length of variable length section
-              varlen = readVarInt(data);
-              if (varlen > data.remaining()) {
-                throw new std::runtime_error("length of variable fields extends past end");
-              }
-            }
 
-            int rv = listener.onStruct(structPtr, _structLen, _constStructFields);
-            if (rv == RV_SKIP_VARIABLE_FIELDS) {
-              data.ptr += varlen;
-            }
+          if (_startRow(listener, data, tagbyte, false)) {
+            break;
           }
 
-          break;
-
         } else if (tagid == TFLAGS) {
 
           _flags = (tagbyte >> 4) & 0x07;
 
         } else if (tagid == TBLOCK) {
 
-          // TODO
+          if (_startBlock(listener, data)) { return true; }
 
         } else if (tagid == TTABLE) {
 
@@ -172,9 +233,13 @@ namespace crow {
           // TODO: snapshot decorators
           // clear previous table state.
           _structFields.clear();
+          _structLen = 0;
           _fields.clear();
           _constFields.clear();
           _constStructFields.clear();
+          _selected.clear();
+          _numVarSelected = 0;
+          _compilePredicates();
           _numRows = 0;
           _tableFlags = tagbyte & 0xF0;
 
@@ -221,11 +286,12 @@ namespace crow {
      * Will decode fields, only to skip over it.
      * Will call listener.onRowStart() and listener.onRowEnd() only.
      */
-    bool _doSkipRow(DecoderListener &listener, PData &data) {
+    template<typename L>
+    bool _doSkipRow(L &listener, PData &data) {
       while (true) {
 
         uint8_t tagbyte;
-        if (data.empty()) { _markError(ENOSPC, data); return true; }
+        if (data.empty()) { return true; }  // end of data
         tagbyte = *data.ptr++;
         bool isIndex = (tagbyte & (uint8_t)0x80) != 0;
         uint8_t tagid = tagbyte & 0x0F;
@@ -236,49 +302,23 @@ namespace crow {
           if (index >= _fields.size()) {
             _markError(EINVAL, data); return true;
           }
-          SPFieldInfo pField = _fields[index];
-
-          if (_decodeValue(pField, data, listener)) {
+          if (_decodeValue(_constFields[index], data, listener)) {
             break;
           }
 
         } else if (tagid == TROW) {
-          listener.onRowEnd((_numRows == 0),_data.start + _rowStartPos, (size_t)(_data.getOffset() - _rowStartPos - 1));
-
-          _flags = (tagbyte >> 4) & 0x07;
-          _rowStartPos = data.getOffset();
-          { listener.onRowStart(); }
-          if (_structLen > 0) {
-            //auto structPtr = data.ptr;
-            if (data.remaining() < _structLen) {
-              throw new std::runtime_error("no more data, trying to read struct");
-            }
-            data.ptr += _structLen;
-            // read struct
-            size_t varlen = 0;
-            if (_fields.size() > _structFields.size()) {
-              // read length of variable length section
-              varlen = readVarInt(data);
-              if (varlen > data.remaining()) {
-                throw new std::runtime_error("length of variable fields extends past end");
-              }
-            }
 
-            //int rv = listener.onStruct(structPtr, _structLen, _constStructFields);
-            if (true) {//rv == RV_SKIP_VARIABLE_FIELDS) {
-              data.ptr += varlen;
-            }
+          if (_startRow(listener, data, tagbyte, true)) {
+            break;
           }
 
-          break;
-
         } else if (tagid == TFLAGS) {
 
           _flags = (tagbyte >> 4) & 0x07;
 
         } else if (tagid == TBLOCK) {
 
-          // TODO
+          if (_startBlock(listener, data)) { return true; }
 
         } else if (tagid == TTABLE) {
 
@@ -286,9 +326,13 @@ namespace crow {
           // TODO: snapshot decorators
           // clear previous table state.
           _structFields.clear();
+          _structLen = 0;
           _fields.clear();
           _constFields.clear();
           _constStructFields.clear();
+          _selected.clear();
+          _numVarSelected = 0;
+          _compilePredicates();
           _numRows = 0;
           _tableFlags = tagbyte & 0xF0;
 
@@ -309,6 +353,115 @@ namespace crow {
       return false;
     }
 
+    /*
+     * Handle TBLOCK: end last row of previous block, and check the block
+     * is all there.  The TTABLE at start of block resets table state.
+     * returns true on error.
+     */
+    template<typename L>
+    bool _startBlock(L &listener, PData &data) {
+      if (_numRows > 0 && !_rowRejected) {
+        listener.onRowEnd(false, _data.start + _rowStartPos, (size_t)(_data.getOffset() - _rowStartPos - 1));
+      }
+      _numRows = 0;
+      _rowRejected = false;
+
+      if (data.remaining() < BLOCK_LEN_SIZE) {
+        _markError(ENOSPC, data); return true;
+      }
+      uint32_t blockLen = 0;
+      for (int i=0; i < BLOCK_LEN_SIZE; i++) {
+        blockLen |= ((uint32_t)data.ptr[i]) << (8 * i);
+      }
+      data.ptr += BLOCK_LEN_SIZE;
+      if (blockLen > data.remaining()) {
+        _markError(ENOSPC, data); return true;
+      }
+      _rowStartPos = data.getOffset();
+      return false;
+    }
+
+    /*
+     * Handle TROW: end previous row, and start the next one unless it
+     * fails the predicates.  Rejected rows are skipped without any
+     * listener call.
+     * returns true if row was started, false if it was rejected.
+     */
+    template<typename L>
+    bool _startRow(L &listener, PData &data, uint8_t tagbyte, bool skipMode) {
+      if (!_rowRejected) {
+        listener.onRowEnd((_numRows == 0), _data.start + _rowStartPos, (size_t)(_data.getOffset() - _rowStartPos - 1));
+      }
+      _rowRejected = false;
+
+      _flags = (tagbyte >> 4) & 0x07;
+      _rowStartPos = data.getOffset();
+
+      // framed rows give end of row up front
+
+      const uint8_t *rowEnd = nullptr;
+      if (_tableFlags & TABLE_FLAG_FRAMED) {
+        uint64_t rowLen = readVarInt(data);
+        if (rowLen > data.remaining()) {
+          _markError(ENOSPC, data);
+          _rowRejected = true;
+          return false;
+        }
+        rowEnd = data.ptr + rowLen;
+      }
+
+      if (_structLen == 0) {
+        if (!_predicates.empty()) {
+          PData row(data.ptr, (size_t)((rowEnd != nullptr ? rowEnd : data.end) - data.ptr));
+          if (!_rowMatches(nullptr, row, rowEnd == nullptr)) {
+            data.ptr = (rowEnd != nullptr ? rowEnd : row.ptr);
+            _rowRejected = true;
+            return false;
+          }
+        }
+        listener.onRowStart();
+        if (skipMode && rowEnd != nullptr) {
+          data.ptr = rowEnd;
+        }
+        return true;
+      }
+
+      auto structPtr = data.ptr;
+      if (data.remaining() < _structLen) {
+        throw new std::runtime_error("no more data, trying to read struct");
+      }
+      data.ptr += _structLen;
+      // read struct
+      size_t varlen = 0;
+      if (_fields.size() > _structFields.size()) {
+        // read length of variable length section
+        varlen = readVarInt(data);
+        if (varlen > data.remaining()) {
+          throw new std::runtime_error("length of variable fields extends past end");
+        }
+      }
+
+      if (!_predicates.empty()) {
+        PData row(data.ptr, varlen);
+        if (!_rowMatches(structPtr, row, false)) {
+          data.ptr += varlen;
+          _rowRejected = true;
+          return false;
+        }
+      }
+
+      listener.onRowStart();
+      if (skipMode) {
+        data.ptr += varlen;
+        return true;
+      }
+      int rv = listener.onStruct(structPtr, _structLen, _constStructFields);
+      if (rv == RV_SKIP_VARIABLE_FIELDS || (_hasProjection && _numVarSelected == 0)) {
+        data.ptr += varlen;
+      }
+      return true;
+    }
+
     SPCFieldInfo _decodeFieldInfo(PData &data, uint8_t tagbyte) {
 
       bool has_subid = (tagbyte & FIELDINFO_FLAG_HAS_SUBID) != 0;
@@ -377,12 +530,17 @@ namespace crow {
       SPFieldInfo field = std::make_shared<FieldInfo>(fieldDef, index, fixedLen);
       _fields.push_back(field);
       _constFields.push_back(field);
+      _selected.push_back(_isSelected(*field));
+      if (_selected.back() && !isRaw) { _numVarSelected++; }
 
       if (isRaw) {
         _structFields.push_back(field);
         _constStructFields.push_back(field);
         _structLen += fixedLen;
       }
+      if (!_predicates.empty()) {
+        _compilePredicates();
+      }
 
       return field;
     }
@@ -399,6 +557,85 @@ namespace crow {
 
     virtual size_t getExpandedSize() override { return _byteCount; }
 
+    void setProjection(const std::vector<uint32_t> &fieldIds) override {
+      _projIds = fieldIds;
+      _projNames.clear();
+      _applyProjection();
+    }
+
+    void setProjection(const std::vector<std::string> &fieldNames) override {
+      _projIds.clear();
+      _projNames = fieldNames;
+      _applyProjection();
+    }
+
+    int addPredicate(const Predicate &predicate) override {
+      size_t n = predicate.values.size();
+      bool valid = (predicate.op == Predicate::EQUALS ? n == 1 :
+                    predicate.op == Predicate::RANGE ? n == 2 : n > 0);
+      if (!valid || (predicate.fieldId == 0 && predicate.fieldName.empty())) {
+        return -1;
+      }
+      _predicates.push_back(predicate);
+      _compilePredicates();
+      return 0;
+    }
+
+    /*
+     * Continue decoding over the next buffer, keeping fields and table
+     * state.  Used by StreamDecoder.
+     */
+    void _setData(const uint8_t *pEncData, size_t encLength) {
+      _data = PData(pEncData, encLength);
+      _rowStartPos = 0;
+      _byteCount += encLength;
+    }
+
+    /*
+     * Decode rest of current buffer, without the end of data handling
+     * of decode().  returns number of rows started.
+     */
+    template<typename L>
+    uint32_t _decodeAvailable(L &listener) {
+      uint32_t n = 0;
+      while (false == _decodeRow(listener)) {
+        _numRows++;
+        n++;
+      }
+      return n;
+    }
+
+    /*
+     * Notify end of current row, if not done yet.  The next TROW does
+     * not notify again.
+     */
+    template<typename L>
+    void _endRow(L &listener) {
+      if (_numRows > 0 && !_rowRejected) {
+        listener.onRowEnd(false, _data.start + _rowStartPos, (size_t)(_data.getOffset() - _rowStartPos));
+        _rowRejected = true;
+      }
+    }
+
+    uint32_t skipRows(uint32_t count) override {
+      StaticDecoderListener none;
+      _skipRow(_data);
+      uint32_t n = 0;
+      while (n < count && !_data.empty()) {
+        if (BRANCH_UNLIKELY_(_data.getOffset() >= _windowEnd)) { _onWindow(); }
+        if (_doSkipRow(none, _data)) { break; }
+        _skipRow(_data);   // values of rows that are not framed
+        n++;
+      }
+      _rowRejected = true;  // no onRowEnd for last skipped row
+      return n;
+    }
+
+    void clearPredicates() override {
+      _predicates.clear();
+      _compilePredicates();
+    }
+
     virtual std::vector<SPCFieldInfo> getFields() override {
       auto tmp = std::vector<SPCFieldInfo>();
       for (auto f : _fields) { tmp.push_back(f); }
@@ -409,9 +646,26 @@ namespace crow {
       return tmp;
     }
 
+  protected:
+
+    /*
+     * Called before the row at offset _windowEnd or later is decoded,
+     * for subclasses that manage the memory being decoded.
+     */
+    virtual void _onWindow() { _windowEnd = SIZE_MAX; }
+
+    /*
+     * Offset of next _onWindow() call, SIZE_MAX for none.
+     */
+    void _setWindowEnd(size_t offset) { _windowEnd = offset; }
+
+    size_t _offset() { return _data.getOffset(); }
+    size_t _rowStart() const { return _rowStartPos; }
+
   private:
 
-    bool _decodeValue(SPCFieldInfo pField, PData &data, DecoderListener &listener) {
+    template<typename L>
+    bool _decodeValue(const SPCFieldInfo &pField, PData &data, L &listener) {
       if (data.empty()) { _markError(ENOSPC, data); return true; }
 
       switch(pField->typeId) {
@@ -429,6 +683,22 @@ namespace crow {
         }
         break;
 
+        // 16 bit values are delivered as 32 bit
+
+        case TINT16: {
+          uint64_t tmp = readVarInt(data);
+          int32_t val = (int16_t)ZigZagDecode32((uint32_t)tmp);
+          if (NOT_SKIP_MODE) { listener.onField(pField, val, _flags); }
+        }
+        break;
+
+        case TUINT16: {
+          uint64_t tmp = readVarInt(data);
+          uint32_t val = (uint16_t)tmp;
+          if (NOT_SKIP_MODE) { listener.onField(pField, val, _flags); }
+        }
+        break;
+
         case TINT64: {
           uint64_t tmp = readVarInt(data);
           int64_t val = ZigZagDecode64(tmp);
@@ -474,10 +744,7 @@ namespace crow {
             _markError(ENOSPC, data);
             break;
           }
-          if (NOT_SKIP_MODE) {
-            std::string s(reinterpret_cast<char const*>(data.ptr), (size_t)len);
-            listener.onField(pField, s, _flags);
-          }
+          if (NOT_SKIP_MODE) { listener.onField(pField, ByteView(data.ptr, (size_t)len), _flags); }
           data.ptr += len;
         }
         break;
@@ -488,11 +755,8 @@ namespace crow {
             _markError(ENOSPC, data);
             break;
           }
-          auto vec = std::vector<uint8_t>();
-          vec.resize(len);
-          memcpy(vec.data(), data.ptr, (size_t)len);
+          if (NOT_SKIP_MODE) { listener.onField(pField, ByteView(data.ptr, (size_t)len), _flags); }
           data.ptr += len;
-          if (NOT_SKIP_MODE) { listener.onField(pField, vec, _flags); }
         }
         break;
 
@@ -502,6 +766,286 @@ namespace crow {
       return false;
     }
 
+    /*
+     * Predicate with values converted to the type of its field.
+     */
+    struct CompiledPredicate {
+      Predicate::Op            op;
+      size_t                   structOffset;
+      std::vector<int64_t>     ivals;
+      std::vector<uint64_t>    uvals;
+      std::vector<double>      dvals;
+      std::vector<std::string> svals;
+      bool                     matched;
+    };
+
+    /*
+     * Bind predicates to fields of the current table.  Predicates on
+     * fields not defined yet never match.
+     */
+    void _compilePredicates() {
+      _compiled.clear();
+      _fieldPreds.assign(_fields.size(), std::vector<size_t>());
+
+      for (const Predicate &pred : _predicates) {
+        size_t structOffset = 0;
+        for (size_t i=0; i < _fields.size(); i++) {
+          const FieldInfo &field = *_fields[i];
+          bool isMatch = (pred.fieldId > 0 ? field.id == pred.fieldId : field.name == pred.fieldName);
+          if (isMatch) {
+            CompiledPredicate cp;
+            cp.op = pred.op;
+            cp.structOffset = structOffset;
+            cp.matched = false;
+            for (const DynVal &v : pred.values) {
+              switch (field.typeId) {
+                case TINT8: case TINT16: case TINT32: case TINT64:
+                  cp.ivals.push_back(v.as_i64());
+                  break;
+                case TUINT8: case TUINT16: case TUINT32: case TUINT64:
+                  cp.uvals.push_back(v.as_u64());
+                  break;
+                case TFLOAT32: case TFLOAT64:
+                  cp.dvals.push_back(v.as_double());
+                  break;
+                default:
+                  cp.svals.push_back(v.as_s());
+                  break;
+              }
+            }
+            _fieldPreds[i].push_back(_compiled.size());
+            _compiled.push_back(cp);
+            break;
+          }
+          structOffset += field.structFieldLength;
+        }
+      }
+      _numUnbound = _predicates.size() - _compiled.size();
+    }
+
+    /*
+     * Evaluate predicates against struct data, if any, and the variable
+     * fields in row.  If needRowEnd, moves row.ptr to end of row,
+     * otherwise returns as soon as a predicate fails.
+     */
+    bool _rowMatches(const uint8_t *structPtr, PData &row, bool needRowEnd) {
+      if (_numUnbound > 0) {
+        if (needRowEnd) { _skipRow(row); }
+        return false;
+      }
+      for (auto &cp : _compiled) { cp.matched = false; }
+
+      if (structPtr != nullptr) {
+        for (size_t i=0; i < _structFields.size(); i++) {
+          const FieldInfo &field = *_structFields[i];
+          for (size_t pi : _fieldPreds[field.index]) {
+            _testStructValue(_compiled[pi], field, structPtr + _compiled[pi].structOffset);
+            if (!_compiled[pi].matched && !needRowEnd) { return false; }
+          }
+        }
+      }
+
+      while (!row.empty() && (*row.ptr & 0x80) != 0) {
+        uint8_t index = *row.ptr++ & 0x7F;
+        if (index >= _fields.size()) {
+          break;
+        }
+        const FieldInfo &field = *_fields[index];
+        if (_fieldPreds[index].empty()) {
+          _skipValue(field.typeId, row);
+        } else {
+          _testVarValue(field, _fieldPreds[index], row);
+          if (!needRowEnd) {
+            for (size_t pi : _fieldPreds[index]) {
+              if (!_compiled[pi].matched) { return false; }
+            }
+          }
+        }
+      }
+
+      for (const auto &cp : _compiled) {
+        if (!cp.matched) { return false; }
+      }
+      return true;
+    }
+
+    void _skipRow(PData &row) {
+      while (!row.empty() && (*row.ptr & 0x80) != 0) {
+        uint8_t index = *row.ptr++ & 0x7F;
+        if (index >= _fields.size()) { break; }
+        _skipValue(_fields[index]->typeId, row);
+      }
+    }
+
+    void _testVarValue(const FieldInfo &field, const std::vector<size_t> &preds, PData &data) {
+      switch (field.typeId) {
+        case TINT8:
+          if (data.empty()) { return; }
+          _testAll(preds, &CompiledPredicate::ivals, (int64_t)(int8_t)*data.ptr++);
+          break;
+        case TUINT8:
+          if (data.empty()) { return; }
+          _testAll(preds, &CompiledPredicate::uvals, (uint64_t)*data.ptr++);
+          break;
+        case TINT16:
+        case TINT32:
+          _testAll(preds, &CompiledPredicate::ivals, (int64_t)ZigZagDecode32((uint32_t)readVarInt(data)));
+          break;
+        case TINT64:
+          _testAll(preds, &CompiledPredicate::ivals, ZigZagDecode64(readVarInt(data)));
+          break;
+        case TUINT16:
+        case TUINT32:
+        case TUINT64:
+          _testAll(preds, &CompiledPredicate::uvals, readVarInt(data));
+          break;
+        case TFLOAT32:
+          _testAll(preds, &CompiledPredicate::dvals, (double)DecodeFloat(readFixed32(data)));
+          break;
+        case TFLOAT64:
+          _testAll(preds, &CompiledPredicate::dvals, DecodeDouble(readFixed64(data)));
+          break;
+        case TSTRING:
+        case TBYTES: {
+          uint64_t len = readVarInt(data);
+          if (data.remaining() < len) {
+            data.ptr = data.end;
+            return;
+          }
+          ByteView value(data.ptr, (size_t)len);
+          data.ptr += len;
+          for (size_t pi : preds) { _testBytes(_compiled[pi], value); }
+          break;
+        }
+        default:
+          _skipValue(field.typeId, data);
+          break;
+      }
+    }
+
+    /*
+     * struct values are in native byte order.
+     */
+    void _testStructValue(CompiledPredicate &cp, const FieldInfo &field, const uint8_t *p) {
+      switch (field.typeId) {
+        case TINT8: _test(cp, cp.ivals, (int64_t)(int8_t)*p); break;
+        case TUINT8: _test(cp, cp.uvals, (uint64_t)*p); break;
+        case TINT16: _test(cp, cp.ivals, (int64_t)_load<int16_t>(p)); break;
+        case TUINT16: _test(cp, cp.uvals, (uint64_t)_load<uint16_t>(p)); break;
+        case TINT32: _test(cp, cp.ivals, (int64_t)_load<int32_t>(p)); break;
+        case TUINT32: _test(cp, cp.uvals, (uint64_t)_load<uint32_t>(p)); break;
+        case TINT64: _test(cp, cp.ivals, _load<int64_t>(p)); break;
+        case TUINT64: _test(cp, cp.uvals, _load<uint64_t>(p)); break;
+        case TFLOAT32: _test(cp, cp.dvals, (double)_load<float>(p)); break;
+        case TFLOAT64: _test(cp, cp.dvals, _load<double>(p)); break;
+        case TSTRING: {
+          const void *pNul = memchr(p, 0, field.structFieldLength);
+          size_t len = (pNul == nullptr ? field.structFieldLength : (size_t)((const uint8_t *)pNul - p));
+          _testBytes(cp, ByteView(p, len));
+          break;
+        }
+        case TBYTES: _testBytes(cp, ByteView(p, field.structFieldLength)); break;
+        default: break;
+      }
+    }
+
+    template<typename T>
+    void _testAll(const std::vector<size_t> &preds, std::vector<T> CompiledPredicate::*member, T value) {
+      for (size_t pi : preds) {
+        CompiledPredicate &cp = _compiled[pi];
+        _test(cp, cp.*member, value);
+      }
+    }
+
+    template<typename T>
+    static void _test(CompiledPredicate &cp, const std::vector<T> &vals, T value) {
+      switch (cp.op) {
+        case Predicate::EQUALS: cp.matched = (value == vals[0]); break;
+        case Predicate::RANGE: cp.matched = (vals[0] <= value && value <= vals[1]); break;
+        case Predicate::IN_SET: cp.matched = (std::find(vals.begin(), vals.end(), value) != vals.end()); break;
+      }
+    }
+
+    static int _compare(const ByteView &a, const std::string &b) {
+      size_t n = std::min(a.size(), b.size());
+      int rv = (n == 0 ? 0 : memcmp(a.data(), b.data(), n));
+      if (rv != 0) { return rv; }
+      return (a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0));
+    }
+
+    static void _testBytes(CompiledPredicate &cp, const ByteView &value) {
+      const std::vector<std::string> &vals = cp.svals;
+      switch (cp.op) {
+        case Predicate::EQUALS: cp.matched = (value == vals[0]); break;
+        case Predicate::RANGE: cp.matched = (_compare(value, vals[0]) >= 0 && _compare(value, vals[1]) <= 0); break;
+        case Predicate::IN_SET:
+          cp.matched = false;
+          for (const std::string &v : vals) {
+            if (value == v) { cp.matched = true; break; }
+          }
+          break;
+      }
+    }
+
+    template<typename T>
+    static T _load(const uint8_t *p) {
+      T value;
+      memcpy(&value, p, sizeof(value));
+      return value;
+    }
+
+    bool _isSelected(const FieldInfo &field) const {
+      if (!_hasProjection) { return true; }
+      if (field.id > 0 && std::find(_projIds.begin(), _projIds.end(), field.id) != _projIds.end()) {
+        return true;
+      }
+      return !field.name.empty() &&
+        std::find(_projNames.begin(), _projNames.end(), field.name) != _projNames.end();
+    }
+
+    void _applyProjection() {
+      _hasProjection = !_projIds.empty() || !_projNames.empty();
+      _numVarSelected = 0;
+      for (size_t i=0; i < _fields.size(); i++) {
+        _selected[i] = _isSelected(*_fields[i]);
+        if (_selected[i] && !_fields[i]->isStructField()) { _numVarSelected++; }
+      }
+    }
+
+    /*
+     * Move past a value without decoding it.
+     */
+    void _skipValue(CrowType typeId, PData &data) {
+      switch (typeId) {
+        case TINT8:
+        case TUINT8:
+          _skipBytes(1, data);
+          break;
+        case TFLOAT32:
+          _skipBytes(sizeof(uint32_t), data);
+          break;
+        case TFLOAT64:
+          _skipBytes(sizeof(uint64_t), data);
+          break;
+        case TSTRING:
+        case TBYTES:
+          _skipBytes(readVarInt(data), data);
+          break;
+        default:
+          // varint, ends at first byte without upper bit
+          while (!data.empty() && (*data.ptr++ & 0x80) != 0) {}
+          break;
+      }
+    }
+
+    void _skipBytes(uint64_t len, PData &data) {
+      if (data.remaining() < len) {
+        _markError(ENOSPC, data);
+        return;
+      }
+      data.ptr += len;
+    }
+
     const SetContext* _putSet(uint8_t setId, const uint8_t* ptr, size_t len)
     {
       auto pContext = new SetContext(setId, ptr, len);
@@ -517,7 +1061,7 @@ namespace crow {
     }
 
     void _markError(int errCode, PData &data) {
-      if (_err == 0) return;
+      if (_err != 0) return;
       _err = errCode;
       _errOffset = (data.ptr - data.start);
       data.ptr = data.end;
@@ -567,6 +1111,19 @@ namespace crow {
     std::vector<SPCFieldInfo> _constStructFields;
     uint8_t _tableFlags;
 
+    std::vector<uint32_t>    _projIds;
+    std::vector<std::string> _projNames;
+    bool                     _hasProjection;
+    std::vector<bool>        _selected;        // by field index
+    size_t                   _numVarSelected;  // selected fields that are not struct fields
+
+    std::vector<Predicate>           _predicates;
+    std::vector<CompiledPredicate>   _compiled;
+    std::vector<std::vector<size_t>> _fieldPreds;   // by field index, indexes into _compiled
+    size_t                           _numUnbound;   // predicates on fields not in table
+    bool                             _rowRejected;
+    size_t                           _windowEnd;    // offset of next _onWindow() call
+
 /*
     bool           _isDecoratorTable;
     std::vector<SPFieldInfo> _decoratorFields;
@@ -574,6 +1131,14 @@ namespace crow {
     std::vector<DecColValue> _decoratorValues;
 */
     uint64_t readVarInt(PData &data) {
+      // fast path, no bounds checks needed
+      if (BRANCH_LIKELY_(data.remaining() >= 16)) {
+        uint64_t value;
+        data.ptr += decodeVarIntFast(data.ptr, value);
+        return value;
+      }
+
+      // near end of buffer
       uint64_t value = 0L;
       uint64_t shift = 0L;
 
@@ -589,9 +1154,368 @@ namespace crow {
 
   };
 
+  /*
+   * Decodes a memory mapped file.  The kernel is asked to read ahead a
+   * window past the decode position, and pages of rows already decoded
+   * are released, so resident memory stays bounded for any file size.
+   * Released pages are read again from the file if touched.
+   */
+  class MappedFileDecoder : public DecoderImpl {
+  public:
+    static const size_t DEFAULT_WINDOW = 8 * 1024 * 1024;
+
+    MappedFileDecoder(const uint8_t *pMap, size_t mapLength, size_t windowSize = DEFAULT_WINDOW) :
+      DecoderImpl(pMap, mapLength), _map(pMap), _mapLength(mapLength), _window(windowSize),
+      _released(0), _pageSize((size_t)sysconf(_SC_PAGESIZE)) {
+      if (_window < _pageSize) { _window = _pageSize; }
+      _window -= _window % _pageSize;
+      if (_map != nullptr) {
+        madvise((void *)_map, _mapLength, MADV_SEQUENTIAL);
+        _willNeed(0);
+      }
+      _setWindowEnd(_mapLength > _window ? _window : SIZE_MAX);
+    }
+
+    ~MappedFileDecoder() {
+      if (_map != nullptr) { munmap((void *)_map, _mapLength); }
+    }
+
+  protected:
+
+    void _onWindow() override {
+      // release pages behind current row
+
+      size_t behind = _rowStart();
+      if (behind > _offset()) { behind = _offset(); }
+      behind -= behind % _pageSize;
+      if (behind > _released) {
+        madvise((void *)(_map + _released), behind - _released, MADV_DONTNEED);
+        _released = behind;
+      }
+
+      // read ahead the window after the next one
+
+      size_t windowEnd = (_offset() / _window + 1) * _window;
+      _willNeed(windowEnd);
+      _setWindowEnd(windowEnd >= _mapLength ? SIZE_MAX : windowEnd);
+    }
+
+  private:
+
+    /*
+     * hint that window at start, and the one after, are needed soon.
+     */
+    void _willNeed(size_t start) {
+      if (start >= _mapLength) { return; }
+      size_t len = std::min(2 * _window, _mapLength - start);
+      madvise((void *)(_map + start), len, MADV_WILLNEED);
+    }
+
+    const uint8_t *_map;
+    size_t         _mapLength;
+    size_t         _window;
+    size_t         _released;     // pages before offset have been released
+    size_t         _pageSize;
+  };
+
   class DecoderFactory {
   public:
     static Decoder* New(const uint8_t* pEncData, size_t encLength) { return new DecoderImpl(pEncData, encLength); }
+
+    /*
+     * Decode file contents, mapped into memory rather than read.
+     * windowSize is how far ahead of decoding the file is read.
+     * returns nullptr with errno set if file can't be opened or mapped.
+     */
+    static Decoder* NewFromFile(const std::string &path, size_t windowSize = MappedFileDecoder::DEFAULT_WINDOW) {
+      int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0) { return nullptr; }
+
+      struct stat st;
+      if (fstat(fd, &st) != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return nullptr;
+      }
+
+      size_t len = (size_t)st.st_size;
+      void *p = nullptr;
+      if (len > 0) {
+        p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+          int err = errno;
+          close(fd);
+          errno = err;
+          return nullptr;
+        }
+      }
+      close(fd);   // mapping stays valid
+
+      return new MappedFileDecoder((const uint8_t *)p, len, windowSize);
+    }
+  };
+
+  /*
+   * Finds the end of the complete units at the start of a buffer: field
+   * headers, table tags and whole rows.  Tracks the field types of the
+   * units it passes, so it can step over values without decoding them.
+   */
+  class StreamScanner {
+  public:
+    StreamScanner() : _types(), _numStructFields(0), _structLen(0), _framed(false) {}
+
+    /*
+     * Sets complete to length of complete units at start of [p, p+len).
+     * A row that is not framed ends at the next tag, so the last one is
+     * only complete at end of stream, when atEnd is set.
+     * returns 0 on success, EINVAL if data is not valid.
+     */
+    int scan(const uint8_t *p, size_t len, bool atEnd, size_t &complete) {
+      const uint8_t *start = p;
+      const uint8_t *end = p + len;
+      complete = 0;
+
+      while (p < end) {
+        uint8_t tagbyte = *p;
+        uint8_t tagid = tagbyte & 0x0F;
+        const uint8_t *q = p + 1;
+        int rv = 0;
+
+        if ((tagbyte & 0x80) != 0) {
+          // values outside of a row
+          rv = _skipValues(p, end, atEnd, q);
+        } else if (tagid == TROW) {
+          rv = _skipRow(q, end, atEnd);
+        } else if (tagid == THFIELD) {
+          rv = _scanFieldInfo(tagbyte, q, end);
+        } else if (tagid == TTABLE) {
+          _types.clear();
+          _numStructFields = 0;
+          _structLen = 0;
+          _framed = (tagbyte & TABLE_FLAG_FRAMED) != 0;
+        } else if (tagid == TFLAGS) {
+          // no payload
+        } else if (tagid == TBLOCK) {
+          rv = _scanBlock(q, end);
+        } else {
+          return EINVAL;
+        }
+
+        if (rv == INCOMPLETE) { break; }
+        if (rv != 0) { return rv; }
+        p = q;
+        complete = (size_t)(p - start);
+      }
+      return 0;
+    }
+
+  private:
+    static const int INCOMPLETE = -1;
+
+    static bool _readVarInt(const uint8_t *&q, const uint8_t *end, uint64_t &value) {
+      value = 0;
+      for (int shift = 0; q < end && shift < 64; shift += 7) {
+        uint8_t b = *q++;
+        value |= ((uint64_t)(b & 0x7F)) << shift;
+        if ((b & 0x80) == 0) { return true; }
+      }
+      return false;
+    }
+
+    static bool _skip(const uint8_t *&q, const uint8_t *end, uint64_t len) {
+      if ((uint64_t)(end - q) < len) { return false; }
+      q += len;
+      return true;
+    }
+
+    /*
+     * A block is decoded as one unit, so wait for all of it.  The end of
+     * the block ends its last row.
+     */
+    int _scanBlock(const uint8_t *&q, const uint8_t *end) {
+      if (end - q < BLOCK_LEN_SIZE) { return INCOMPLETE; }
+      size_t blockLen = 0;
+      for (int i=0; i < BLOCK_LEN_SIZE; i++) {
+        blockLen |= ((size_t)q[i]) << (8 * i);
+      }
+      if ((size_t)(end - q) - BLOCK_LEN_SIZE < blockLen) { return INCOMPLETE; }
+      q += BLOCK_LEN_SIZE;
+
+      size_t complete;
+      int rv = scan(q, blockLen, true, complete);
+      if (rv != 0) { return rv; }
+      if (complete != blockLen) { return EINVAL; }
+      q += blockLen;
+      return 0;
+    }
+
+    int _skipRow(const uint8_t *&q, const uint8_t *end, bool atEnd) {
+      uint64_t len;
+      if (_framed) {
+        if (!_readVarInt(q, end, len) || !_skip(q, end, len)) { return INCOMPLETE; }
+        return 0;
+      }
+      if (_structLen > 0) {
+        if (!_skip(q, end, _structLen)) { return INCOMPLETE; }
+        if (_types.size() > _numStructFields) {
+          if (!_readVarInt(q, end, len) || !_skip(q, end, len)) { return INCOMPLETE; }
+        }
+        return 0;
+      }
+      return _skipValues(q, end, atEnd, q);
+    }
+
+    /*
+     * Step over index tags and values from p, up to the next tag.
+     */
+    int _skipValues(const uint8_t *p, const uint8_t *end, bool atEnd, const uint8_t *&q) {
+      q = p;
+      while (q < end && (*q & 0x80) != 0) {
+        size_t index = *q++ & 0x7F;
+        if (index >= _types.size()) { return EINVAL; }
+        uint64_t len;
+        bool ok;
+        switch (_types[index]) {
+          case TINT8:
+          case TUINT8: ok = _skip(q, end, 1); break;
+          case TFLOAT32: ok = _skip(q, end, 4); break;
+          case TFLOAT64: ok = _skip(q, end, 8); break;
+          case TSTRING:
+          case TBYTES: ok = _readVarInt(q, end, len) && _skip(q, end, len); break;
+          default: ok = _readVarInt(q, end, len); break;
+        }
+        if (!ok) { return INCOMPLETE; }
+      }
+      return (q < end || atEnd) ? 0 : INCOMPLETE;
+    }
+
+    int _scanFieldInfo(uint8_t tagbyte, const uint8_t *&q, const uint8_t *end) {
+      uint64_t value;
+      if (end - q < 2) { return INCOMPLETE; }
+      q++;  // index
+      uint8_t typeId = *q++ & 0x0F;
+      if (typeId == TNONE || typeId >= CrowType::NUM_TYPES) { return EINVAL; }
+      if (!_readVarInt(q, end, value)) { return INCOMPLETE; }
+      if ((tagbyte & FIELDINFO_FLAG_HAS_SUBID) && !_readVarInt(q, end, value)) { return INCOMPLETE; }
+      if (tagbyte & FIELDINFO_FLAG_HAS_NAME) {
+        if (!_readVarInt(q, end, value) || !_skip(q, end, value)) { return INCOMPLETE; }
+      }
+      if (tagbyte & FIELDINFO_FLAG_RAW) {
+        uint64_t fixedLen = byte_size((CrowType)typeId);
+        if (typeId == TSTRING || typeId == TBYTES) {
+          if (!_readVarInt(q, end, fixedLen)) { return INCOMPLETE; }
+        }
+        _numStructFields++;
+        _structLen += fixedLen;
+      }
+      _types.push_back(typeId);
+      return 0;
+    }
+
+    std::vector<uint8_t> _types;          // by field index
+    size_t               _numStructFields;
+    size_t               _structLen;
+    bool                 _framed;
+  };
+
+  /*
+   * Decodes a stream pushed in chunks of any size, such as reads from
+   * a socket or pipe.  Complete rows are decoded as soon as they
+   * arrive, straight from the caller's chunk.  Only the incomplete
+   * trailing row (or header) is copied and kept until the next feed().
+   * Rows that are not framed end at the next tag, so they are delivered
+   * once the next row starts, or at finish().  With TABLE_FLAG_FRAMED,
+   * rows are delivered as soon as their last byte arrives.  Blocks
+   * (see Encoder::setBlockPolicy) are delivered once the whole block
+   * arrives, so maxPending must be at least the block size.
+   * ByteView values are only valid during the onField() call.
+   */
+  class StreamDecoder {
+  public:
+    StreamDecoder(DecoderListener &listener, size_t maxPending = 64 * 1024 * 1024) :
+      _listener(listener), _decoder(nullptr, 0), _scanner(), _pending(4096),
+      _maxPending(maxPending), _numRows(0), _err(0) {}
+
+    /*
+     * Decode complete rows of data, and keep the rest for the next call.
+     * returns 0 on success, EINVAL if data is not valid, EMSGSIZE if an
+     * incomplete row or block grows past maxPending.  Errors are sticky.
+     */
+    int feed(const uint8_t *data, size_t len) {
+      if (_err != 0) { return _err; }
+      if (len == 0) { return 0; }
+
+      if (_pending.Empty()) {
+        size_t used = _decodeComplete(data, len, false);
+        if (_err == 0 && used < len) {
+          memcpy(_pending.Push(len - used), data + used, len - used);
+        }
+      } else {
+        memcpy(_pending.Push(len), data, len);
+        size_t used = _decodeComplete(_pending.Bottom(), _pending.GetSize(), false);
+        _consumePending(used);
+      }
+
+      if (_err == 0 && _pending.GetSize() > _maxPending) {
+        _err = EMSGSIZE;
+      }
+      return _err;
+    }
+
+    /*
+     * End of stream: decode the last row.
+     * returns 0 on success, ENOSPC if stream ends inside a row or header.
+     */
+    int finish() {
+      if (_err != 0) { return _err; }
+      size_t used = _decodeComplete(_pending.Bottom(), _pending.GetSize(), true);
+      _consumePending(used);
+      if (_err == 0 && !_pending.Empty()) {
+        _err = ENOSPC;
+      }
+      return _err;
+    }
+
+    /*
+     * For setting projection or predicates.
+     */
+    Decoder& decoder() { return _decoder; }
+
+    uint32_t numRows() const { return _numRows; }
+    size_t pending() const { return _pending.GetSize(); }
+    int getErrCode() const { return _err; }
+
+  private:
+
+    size_t _decodeComplete(const uint8_t *p, size_t len, bool atEnd) {
+      size_t complete = 0;
+      int rv = _scanner.scan(p, len, atEnd, complete);
+      if (complete > 0) {
+        _decoder._setData(p, complete);
+        _numRows += _decoder._decodeAvailable(_listener);
+        _decoder._endRow(_listener);
+        rv = (rv != 0 ? rv : _decoder.getErrCode());
+      }
+      if (rv != 0) { _err = rv; }
+      return complete;
+    }
+
+    void _consumePending(size_t used) {
+      size_t rest = _pending.GetSize() - used;
+      if (used > 0 && rest > 0) {
+        memmove(_pending.Bottom(), _pending.Bottom() + used, rest);
+      }
+      _pending.Pop(used);
+    }
+
+    DecoderListener &_listener;
+    DecoderImpl      _decoder;
+    StreamScanner    _scanner;
+    Stack            _pending;     // incomplete trailing row
+    size_t           _maxPending;
+    uint32_t         _numRows;
+    int              _err;
   };
 
 }
@@ -1,6 +1,8 @@
 #ifndef _CROW_ENCODE_IMPL_HPP_
 #define _CROW_ENCODE_IMPL_HPP_
 #include <map>
+#include <chrono>
+#include <mutex>
 #include <errno.h>
 #include <stdexcept>
 #include <unistd.h>
@@ -8,6 +10,7 @@
 #include "../../crow.hpp"
 #include "stack.hpp"
 #include "protobuf_wire_format.h"
+#include "varint.hpp"
 
 #define NONE_LEFT(PTR) (PTR >= _end)
 #define BYTES_REMAIN(PTR) (PTR < _end)
@@ -20,9 +23,12 @@ namespace crow {
     static const uint8_t UPPER_BIT = (uint8_t)0x80;
   public:
     EncoderImpl(size_t initialCapacity) : Encoder(), _stack(initialCapacity),
-          _dataStack(1024), _hdrStack(1024), _fieldMap(), _fields(),
+          _dataStack(1024), _hdrStack(1024), _rowOpen(false), _rowStart(0), _err(0),
+          _policy(), _pendingRows(0), _pendingSince(),
+          _fieldMap(), _fields(),
           _structFields(), _haveStructData(false), _structLen(0),
-          _structDefFinalized(false), _structBuf(0)  {}
+          _structDefFinalized(false), _structBuf(0), _framed(false), _tableFlags(0),
+          _blockPolicy(), _blockOpen(false), _blockStart(0), _blockRows(0)  {}
 
     ~EncoderImpl() { }
 
@@ -32,19 +38,7 @@ int put(const SPFieldDef fieldDef, DynVal value) override {
     return -1;
   }
 
-  SPFieldInfo field = _findFieldInfo(fieldDef);
-  if (!field) {
-    field = _newFieldInfo(fieldDef);
-  }
-
-  if (value.valid()) {
-    writeIndexTag(field);
-    _write(field, value);
-  } else {
-    writeHeaderTag(field);
-  }
-
-  return 0;
+  return put(_getFieldHandle(fieldDef), value);
 }
 
 virtual int put(const DynMap &obj) override {
@@ -54,111 +48,287 @@ virtual int put(const DynMap &obj) override {
   return 0;
 }
 
-/*
-    void put(const SPField field, const std::vector<uint8_t>& value) override {
-      if (isInvalid(field)) {
-        assert(false);
-        return;
+    int put(const SPFieldDef fieldDef, bool value) override { return put(_getFieldHandle(fieldDef), value); }
+    int put(const SPFieldDef fieldDef, int8_t value) override { return put(_getFieldHandle(fieldDef), value); }
+    int put(const SPFieldDef fieldDef, uint8_t value) override { return put(_getFieldHandle(fieldDef), value); }
+    int put(const SPFieldDef fieldDef, int16_t value) override { return put(_getFieldHandle(fieldDef), value); }
+    int put(const SPFieldDef fieldDef, uint16_t value) override { return put(_getFieldHandle(fieldDef), value); }
+    int put(const SPFieldDef fieldDef, int32_t value) override { return put(_getFieldHandle(fieldDef), value); }
+    int put(const SPFieldDef fieldDef, uint32_t value) override { return put(_getFieldHandle(fieldDef), value); }
+    int put(const SPFieldDef fieldDef, int64_t value) override { return put(_getFieldHandle(fieldDef), value); }
+    int put(const SPFieldDef fieldDef, uint64_t value) override { return put(_getFieldHandle(fieldDef), value); }
+    int put(const SPFieldDef fieldDef, float value) override { return put(_getFieldHandle(fieldDef), value); }
+    int put(const SPFieldDef fieldDef, double value) override { return put(_getFieldHandle(fieldDef), value); }
+
+    int put(const SPFieldDef fieldDef, const char *str) override {
+      return put(_getFieldHandle(fieldDef), str);
+    }
+    int put(const SPFieldDef fieldDef, const char *str, size_t len) override {
+      return put(_getFieldHandle(fieldDef), str, len);
+    }
+    int put(const SPFieldDef fieldDef, const std::string &str) override {
+      return put(_getFieldHandle(fieldDef), str);
+    }
+    int put(const SPFieldDef fieldDef, const uint8_t *bytes, size_t len) override {
+      return put(_getFieldHandle(fieldDef), bytes, len);
+    }
+    int put(const SPFieldDef fieldDef, const Bytes &bytes) override {
+      return put(_getFieldHandle(fieldDef), bytes);
+    }
+
+    FieldHandle addField(const SPFieldDef fieldDef) override {
+      FieldHandle h = _getFieldHandle(fieldDef);
+      if (h >= 0) {
+        writeHeaderTag(_fields[h]);
       }
-      writeIndexTag(field);
-      writeVarInt(value.size(), staq());
-      memcpy(staq().Push(value.size()), value.data(), value.size());
+      return h;
     }
-    void put(const SPField field, const uint8_t* bytes, size_t len) override {
-      if (isInvalid(field)) {
-        assert(false);
-        return;
+
+    int put(FieldHandle h, DynVal value) override {
+      if (!_isValidHandle(h)) {
+        return -1;
       }
-      writeIndexTag(field);
-      writeVarInt(len, staq());
-      memcpy(staq().Push(len), bytes, len);
+      FieldInfo &field = _fields[h];
+
+      if (value.valid()) {
+        writeIndexTag(field);
+        _write(field, value);
+      } else {
+        writeHeaderTag(field);
+      }
+
+      return 0;
+    }
+
+    int put(FieldHandle h, bool value) override { return _putNumber(h, (uint8_t)value); }
+    int put(FieldHandle h, int8_t value) override { return _putNumber(h, value); }
+    int put(FieldHandle h, uint8_t value) override { return _putNumber(h, value); }
+    int put(FieldHandle h, int16_t value) override { return _putNumber(h, value); }
+    int put(FieldHandle h, uint16_t value) override { return _putNumber(h, value); }
+    int put(FieldHandle h, int32_t value) override { return _putNumber(h, value); }
+    int put(FieldHandle h, uint32_t value) override { return _putNumber(h, value); }
+    int put(FieldHandle h, int64_t value) override { return _putNumber(h, value); }
+    int put(FieldHandle h, uint64_t value) override { return _putNumber(h, value); }
+    int put(FieldHandle h, float value) override { return _putNumber(h, value); }
+    int put(FieldHandle h, double value) override { return _putNumber(h, value); }
+
+    int put(FieldHandle h, const char *str) override {
+      return _putBytes(h, str, (str == nullptr ? 0 : strlen(str)));
+    }
+    int put(FieldHandle h, const char *str, size_t len) override {
+      return _putBytes(h, str, len);
+    }
+    int put(FieldHandle h, const std::string &str) override {
+      return _putBytes(h, str.data(), str.length());
+    }
+    int put(FieldHandle h, const uint8_t *bytes, size_t len) override {
+      return _putBytes(h, bytes, len);
+    }
+    int put(FieldHandle h, const Bytes &bytes) override {
+      return _putBytes(h, bytes.data(), bytes.size());
     }
-    */
 
-    void _flush(int fd, bool headersOnly=false) {
+    /*
+     * Variable-only rows are encoded in place in _stack, starting at
+     * _rowStart.  Field headers defined while a row is open are spliced
+     * in front of it, which only happens on rows that introduce a field.
+     * Rows of struct tables need the variable section length before the
+     * variable data, so they are staged in _structBuf and _dataStack.
+     * When flushing to a sink, staged sections are handed over as
+     * separate segments rather than copied into _stack.
+     */
+    void _flush(Sink *sink, bool headersOnly=false) {
+      if (sink != nullptr && _blockPolicy.enabled()) {
+        // blocks are written whole, once length is filled in
+        _flush(nullptr, headersOnly);
+        if (!headersOnly) { _closeBlock(); }
+        _writeCompleted(*sink);
+        return;
+      }
+
       // flush header
       if (_hdrStack.GetSize() > 0) {
-        // copy data
-        memcpy(_stack.Push(_hdrStack.GetSize()), _hdrStack.Bottom(), _hdrStack.GetSize());
-        _hdrStack.Clear();
+        _spliceHeaders();
+      }
+
+      if (headersOnly) {
+        if (sink != nullptr) { _writeCompleted(*sink); }
+        return;
+      }
+
+      if (_rowOpen && _framed) {
+        _frameRow();
       }
 
-      if (headersOnly) { return; }
+      // struct row prefix: TROW, struct data, length of variable section
 
-      // write struct data if defined
+      uint8_t rowtag = TROW;
+      uint8_t varlenBuf[MAX_VARINT_LEN];
+      size_t varlenLen = 0;
+      uint8_t rowlenBuf[MAX_VARINT_LEN];
+      size_t rowlenLen = 0;
+      bool haveStructRow = (_structLen > 0 && _haveStructData);
+      bool rowDone = (_rowOpen || haveStructRow);
 
-      if (_structLen > 0 && _haveStructData) {
+      if (haveStructRow) {
 
         if (_structDefFinalized && !_haveStructData) {
           throw new std::runtime_error("row has no struct data");
         }
-        *(_stack.Push(1)) = TROW;
-        memcpy(_stack.Push(_structLen), _structBuf.Bottom(), _structLen);
         _structDefFinalized = true;
 
         // when we have both struct and variable fields, need to write length
         // of variable section after struct data
 
         if (_fields.size() > _structFields.size()) {
-          writeVarInt(_dataStack.GetSize(),_stack);
+          varlenLen = encodeVarInt(_dataStack.GetSize(), varlenBuf);
+        }
+        if (_framed) {
+          rowlenLen = encodeVarInt(_structLen + varlenLen + _dataStack.GetSize(), rowlenBuf);
         }
       }
 
-      // write variable fields
+      if (sink != nullptr && !haveStructRow && _dataStack.GetSize() == 0 && sink->swap(_stack)) {
+        // sink took the output buffer
+        _stack.Clear();
+        _haveStructData = false;
+        _rowOpen = false;
+        _pendingRows = 0;
+        return;
+      }
+
+      if (sink != nullptr) {
+        struct iovec iov[6];
+        int iovcnt = 0;
+        // headers and rows encoded in place, including current row
+        _addSegment(iov, iovcnt, _stack.Bottom(), _stack.GetSize());
+        if (haveStructRow) {
+          _addSegment(iov, iovcnt, &rowtag, 1);
+          _addSegment(iov, iovcnt, rowlenBuf, rowlenLen);
+          _addSegment(iov, iovcnt, _structBuf.Bottom(), _structLen);
+          _addSegment(iov, iovcnt, varlenBuf, varlenLen);
+        }
+        // staged variable fields of struct row
+        _addSegment(iov, iovcnt, _dataStack.Bottom(), _dataStack.GetSize());
 
-      if (_dataStack.GetSize() > 0) {
+        int rv = sink->write(iov, iovcnt);
+        if (rv != 0) { _err = rv; }
+        _pendingRows = 0;
+
+        _stack.Clear();
+        _dataStack.Clear();
+        _haveStructData = false;
+        _rowOpen = false;
+        return;
+      }
 
-        // write TROW, but only if we don't have struct data defined
-        if (_structLen == 0) {
-          *(_stack.Push(1)) = TROW;
+      if (haveStructRow) {
+        _openBlock();
+        *(_stack.Push(1)) = rowtag;
+        if (rowlenLen > 0) {
+          memcpy(_stack.Push(rowlenLen), rowlenBuf, rowlenLen);
+        }
+        memcpy(_stack.Push(_structLen), _structBuf.Bottom(), _structLen);
+        if (varlenLen > 0) {
+          memcpy(_stack.Push(varlenLen), varlenBuf, varlenLen);
         }
+      }
+
+      // write staged variable fields of struct row
+
+      if (_dataStack.GetSize() > 0) {
 
         // copy data
         memcpy(_stack.Push(_dataStack.GetSize()), _dataStack.Bottom(), _dataStack.GetSize());
         _dataStack.Clear();
       }
       _haveStructData = false;
+      _rowOpen = false;
 
-      if (fd > 0) {
-        write(fd, (const void *)_stack.Bottom(), _stack.GetSize());
-        _stack.Clear();
+      if (rowDone && _blockOpen) {
+        _blockRows++;
+        if (_isBlockFull()) { _closeBlock(); }
       }
     }
 
     virtual void startRow() override {
-      _flush(0);
+      _flush(nullptr);
     }
 
     virtual void startTable(int flags) override {
-      _flush(0);
+      _flush(nullptr);
       uint8_t tagid = TTABLE | ((uint8_t)flags & 0x70);
       auto p = _hdrStack.Push(1);
       *p = tagid;
+      _tableFlags = tagid & 0xF0;
+      _framed = (flags & TABLE_FLAG_FRAMED) != 0;
       _fields.clear();
       _structFields.clear();
       _fieldMap.clear();
     }
 
     virtual void flush(bool headersOnly=false) const override {
-      ((EncoderImpl*)this)->_flush(0, headersOnly);
+      EncoderImpl *self = (EncoderImpl*)this;
+      self->_flush(nullptr, headersOnly);
+      if (!headersOnly) { self->_closeBlock(); }
     }
     virtual void flushfd(int fd, bool headersOnly=false) override {
-      _flush(fd, headersOnly);
+      if (fd > 0) {
+        FdSink sink(fd);
+        _flush(&sink, headersOnly);
+      } else {
+        flush(headersOnly);
+      }
+    }
+    virtual void flush(Sink &sink, bool headersOnly=false) override {
+      _flush(&sink, headersOnly);
     }
     virtual void endRow(int fd) override {
-      if (fd > 0) _flush(fd);
+      if (fd > 0) {
+        FdSink sink(fd);
+        _endRow(sink);
+      }
     }
+    virtual void endRow(Sink &sink) override {
+      _endRow(sink);
+    }
+
+    void setFlushPolicy(const FlushPolicy &policy) override { _policy = policy; }
+    void setBlockPolicy(const BlockPolicy &policy) override { _blockPolicy = policy; }
+
+    void sync(int fd) override { flushfd(fd); }
+    void sync(Sink &sink) override { _flush(&sink); }
+
+    int getErrCode() const override { return _err; }
 
 
     const uint8_t* data() const override { flush(); return _stack.Bottom(); }
 
-    size_t size() const override { return _stack.GetSize(); }
+    size_t size() const override {
+      if (_blockOpen) { return _blockStart; }
+      return (_rowOpen ? _rowStart : _stack.GetSize());
+    }
 
     void clear() override {
       _stack.Clear();
+      _dataStack.Clear();
+      _hdrStack.Clear();
+      _structBuf.Clear();
+      _rowOpen = false;
+      _rowStart = 0;
+      _fieldMap.clear();
       _fields.clear();
-      _structLen = 0;
       _structFields.clear();
+      _haveStructData = false;
+      _structLen = 0;
+      _structDefFinalized = false;
+      _pendingRows = 0;
+      _err = 0;
+      _framed = false;
+      _tableFlags = 0;
+      _blockOpen = false;
+      _blockStart = 0;
+      _blockRows = 0;
     }
 
     virtual int struct_hdr(const SPFieldDef fieldDef, int fixedLength = 0) override {
@@ -184,17 +354,16 @@ virtual int put(const DynMap &obj) override {
 
       fixedLength = (fixedLength > 0 ? fixedLength : byte_size(fieldDef->typeId));
 
-      SPFieldInfo field = _findFieldInfo(fieldDef);
-      if (field) {
+      if (_findFieldHandle(fieldDef) >= 0) {
         return -3; // already defined
       }
-      field = _newFieldInfo(fieldDef, fixedLength);
+      FieldHandle h = _newFieldHandle(fieldDef, fixedLength);
 
-      _structFields.push_back(field);
+      _structFields.push_back(h);
 
       _structLen += fixedLength;
 
-      writeIndexTag(field);
+      writeIndexTag(_fields[h]);
 
       return 0;
     }
@@ -218,36 +387,384 @@ virtual int put(const DynMap &obj) override {
       return 0;
     }
 
+    int put_columns(const std::vector<FieldHandle> &fields,
+                    const std::vector<const void *> &columns, size_t nrows) override {
+
+      if (fields.size() != columns.size()) {
+        return -1;
+      }
+      if (_structLen > 0) {
+        return -1;   // rows need put_struct() data
+      }
+
+      // longest row, apart from string and bytes data
+
+      size_t ncols = fields.size();
+      size_t fixedMax = 1 + MAX_VARINT_LEN;  // TROW, row length
+      for (size_t c=0; c < ncols; c++) {
+        if (!_isValidHandle(fields[c]) || columns[c] == nullptr) {
+          return -1;
+        }
+        const FieldInfo &field = _fields[fields[c]];
+        if (field.isStructField()) {
+          return -1;
+        }
+        fixedMax += 1 + MAX_VARINT_LEN;
+      }
+
+      startRow();
+      for (size_t c=0; c < ncols; c++) {
+        writeHeaderTag(_fields[fields[c]]);
+      }
+      _flush(nullptr);
+
+      if (ncols == 0) {
+        return 0;
+      }
+
+      for (size_t row=0; row < nrows; row++) {
+        size_t need = fixedMax;
+        for (size_t c=0; c < ncols; c++) {
+          CrowType typeId = _fields[fields[c]].typeId;
+          if (typeId == TSTRING || typeId == TBYTES) {
+            need += ((const std::string *)columns[c])[row].size();
+          }
+        }
+        _openBlock();
+        _stack.Reserve(need);
+
+        uint8_t *start = _stack.Top();
+        uint8_t *p = start;
+        *p++ = TROW;
+        uint8_t *pRowLen = p;
+        if (_framed) { p++; }
+        for (size_t c=0; c < ncols; c++) {
+          const FieldInfo &field = _fields[fields[c]];
+          *p++ = field.index | UPPER_BIT;
+          p = _encodeCell(p, field.typeId, columns[c], row);
+        }
+        if (_framed) {
+          p = pRowLen + _frameInPlace(pRowLen, (size_t)(p - pRowLen - 1));
+        }
+        _stack.PushUnsafe((size_t)(p - start));
+
+        if (_blockOpen) {
+          _blockRows++;
+          if (_isBlockFull()) { _closeBlock(); }
+        }
+      }
+
+      return 0;
+    }
+
+    /*
+     * Start a row holding the index tagged values at p, encoded by the
+     * caller for fields defined with addField().  The row is open until
+     * the next startRow() or endRow(), as if each value had been put.
+     * returns 0 on success, -1 for tables with struct fields.
+     */
+    int putEncodedRow(const uint8_t *p, size_t len) {
+      if (_structLen > 0) {
+        return -1;
+      }
+      startRow();
+      _openRow();
+      if (len > 0) {
+        memcpy(_stack.Push(len), p, len);
+      }
+      return 0;
+    }
+
   private:
 
+    /*
+     * encode value of column at row into p, which has room for it.
+     * returns end of encoded value.
+     */
+    _ATTRINLINE_ uint8_t* _encodeCell(uint8_t *p, CrowType typeId, const void *column, size_t row) {
+      switch (typeId) {
+        case TINT8:
+          *p++ = (uint8_t)((const int8_t *)column)[row];
+          break;
+        case TUINT8:
+          *p++ = ((const uint8_t *)column)[row];
+          break;
+        case TINT16:
+          p += encodeVarInt(ZigZagEncode32(((const int16_t *)column)[row]), p);
+          break;
+        case TUINT16:
+          p += encodeVarInt(((const uint16_t *)column)[row], p);
+          break;
+        case TINT32:
+          p += encodeVarInt(ZigZagEncode32(((const int32_t *)column)[row]), p);
+          break;
+        case TUINT32:
+          p += encodeVarInt(((const uint32_t *)column)[row], p);
+          break;
+        case TINT64:
+          p += encodeVarInt(ZigZagEncode64(((const int64_t *)column)[row]), p);
+          break;
+        case TUINT64:
+          p += encodeVarInt(((const uint64_t *)column)[row], p);
+          break;
+        case TFLOAT64:
+          memcpy(p, &((const double *)column)[row], sizeof(double));
+          p += sizeof(double);
+          break;
+        case TFLOAT32:
+          memcpy(p, &((const float *)column)[row], sizeof(float));
+          p += sizeof(float);
+          break;
+        case TSTRING:
+        case TBYTES: {
+          const std::string &s = ((const std::string *)column)[row];
+          p += encodeVarInt(s.size(), p);
+          memcpy(p, s.data(), s.size());
+          p += s.size();
+          break;
+        }
+        default:
+          assert(false);
+          break;
+      }
+      return p;
+    }
+
     /**
      * return _stack or _setStack, depending on _setModeEnabled field.
      */
-    Stack & staq() { return _dataStack; } // (_setModeEnabled ? _setStack : _stack); }
+    Stack & staq() { return (_structLen > 0 ? _dataStack : _stack); }
 
     /*
-     *
+     * Place TROW at start of row, if row data is encoded in place.
      */
-    SPFieldInfo _findFieldInfo(const SPFieldDef fieldDef) {
+    void _openRow() {
+      if (_rowOpen || _structLen > 0) { return; }
+      _openBlock();
+      _rowStart = _stack.GetSize();
+      *(_stack.Push(1)) = TROW;
+      if (_framed) {
+        *(_stack.Push(1)) = 0;  // row length, filled in by _frameRow()
+      }
+      _rowOpen = true;
+    }
+
+    /*
+     * Fill in length of open row of a framed table.  One byte is
+     * reserved for the length, longer rows are moved up.
+     */
+    void _frameRow() {
+      size_t bodyLen = _stack.GetSize() - _rowStart - 2;
+      size_t lenLen = varIntSize(bodyLen);
+      if (lenLen > 1) {
+        _stack.Push(lenLen - 1);
+      }
+      _frameInPlace(_stack.Bottom() + _rowStart + 1, bodyLen);
+    }
+
+    /*
+     * Row body of bodyLen bytes follows the one byte reserved at pRowLen.
+     * Writes the length there, moving body up if it takes more than one
+     * byte.  returns size of length and body.
+     */
+    static size_t _frameInPlace(uint8_t *pRowLen, size_t bodyLen) {
+      size_t lenLen = varIntSize(bodyLen);
+      if (lenLen > 1) {
+        memmove(pRowLen + lenLen, pRowLen + 1, bodyLen);
+      }
+      encodeVarIntScalar(bodyLen, pRowLen);  // writes exactly lenLen bytes
+      return lenLen + bodyLen;
+    }
+
+    /*
+     * Move pending field headers from _hdrStack to _stack, in front of
+     * any open row.
+     */
+    void _spliceHeaders() {
+      _openBlock();
+      size_t hdrLen = _hdrStack.GetSize();
+      if (!_rowOpen) {
+        memcpy(_stack.Push(hdrLen), _hdrStack.Bottom(), hdrLen);
+      } else {
+        size_t rowLen = _stack.GetSize() - _rowStart;
+        _stack.Push(hdrLen);
+        uint8_t *rowPtr = _stack.Bottom() + _rowStart;
+        memmove(rowPtr + hdrLen, rowPtr, rowLen);
+        memcpy(rowPtr, _hdrStack.Bottom(), hdrLen);
+        _rowStart += hdrLen;
+      }
+      _hdrStack.Clear();
+    }
+
+    /*
+     * Start a block, if blocks are enabled and none is open.  All fields
+     * of the table are defined again, so the block stands alone.
+     */
+    void _openBlock() {
+      if (_blockOpen || !_blockPolicy.enabled()) { return; }
+      _blockStart = _stack.GetSize();
+      _blockRows = 0;
+      _blockOpen = true;
+
+      uint8_t *p = _stack.Push(2 + BLOCK_LEN_SIZE);
+      p[0] = TBLOCK;
+      memset(p + 1, 0, BLOCK_LEN_SIZE);     // filled in by _closeBlock()
+      p[1 + BLOCK_LEN_SIZE] = TTABLE | _tableFlags;
+
+      // pending headers are a subset of these
+
+      _hdrStack.Clear();
+      for (auto &field : _fields) {
+        field.isWritten = false;
+        writeHeaderTag(field);
+      }
+      memcpy(_stack.Push(_hdrStack.GetSize()), _hdrStack.Bottom(), _hdrStack.GetSize());
+      _hdrStack.Clear();
+    }
+
+    /*
+     * Fill in length of open block.  Call with no row open.
+     */
+    void _closeBlock() {
+      if (!_blockOpen) { return; }
+      size_t len = _stack.GetSize() - _blockStart - 1 - BLOCK_LEN_SIZE;
+      if (len > UINT32_MAX) {
+        throw new std::runtime_error("block larger than 4GB");
+      }
+      uint8_t *p = _stack.Bottom() + _blockStart + 1;
+      for (int i=0; i < BLOCK_LEN_SIZE; i++) {
+        p[i] = (uint8_t)(len >> (8 * i));
+      }
+      _blockOpen = false;
+    }
+
+    bool _isBlockFull() const {
+      if (_blockPolicy.maxRows > 0 && _blockRows >= _blockPolicy.maxRows) {
+        return true;
+      }
+      return (_blockPolicy.maxBytes > 0 && (_stack.GetSize() - _blockStart) >= _blockPolicy.maxBytes);
+    }
+
+    /*
+     * Drop completed output from _stack, keeping any open block or row.
+     */
+    void _discardCompleted() {
+      size_t keep = size();
+      if (keep == _stack.GetSize()) {
+        _stack.Clear();
+        return;
+      }
+      size_t rest = _stack.GetSize() - keep;
+      memmove(_stack.Bottom(), _stack.Bottom() + keep, rest);
+      _stack.Pop(keep);
+      if (_rowOpen) { _rowStart -= keep; }
+      if (_blockOpen) { _blockStart -= keep; }
+    }
+
+    /*
+     * Close current row, and write buffered rows to sink if the flush
+     * policy says they are due.
+     */
+    void _endRow(Sink &sink) {
+      if (_blockPolicy.enabled()) {
+        _flush(nullptr);
+        if (size() > 0 && (sink.ready() || _isOverCap())) { _writeCompleted(sink); }
+        return;
+      }
+
+      auto now = std::chrono::steady_clock::now();
+      if (_pendingRows == 0) {
+        _pendingSince = now;
+      }
+      _pendingRows++;
+
+      if (_isFlushDue(now) && (sink.ready() || _isOverCap())) {
+        _flush(&sink);
+      } else {
+        _flush(nullptr);
+      }
+    }
+
+    bool _isFlushDue(std::chrono::steady_clock::time_point now) const {
+      if (_policy.maxRows > 0 && _pendingRows >= _policy.maxRows) {
+        return true;
+      }
+      if (_policy.maxBytes > 0 &&
+          (_stack.GetSize() + _dataStack.GetSize() + _structLen) >= _policy.maxBytes) {
+        return true;
+      }
+      if (_policy.maxLatencyMs > 0 &&
+          (now - _pendingSince) >= std::chrono::milliseconds(_policy.maxLatencyMs)) {
+        return true;
+      }
+      return false;
+    }
+
+    /*
+     * Buffered output has reached the cap for a sink that is not ready.
+     */
+    bool _isOverCap() const {
+      return (_policy.maxBufferedBytes > 0 &&
+              (_stack.GetSize() + _dataStack.GetSize()) >= _policy.maxBufferedBytes);
+    }
+
+    void _writeCompleted(Sink &sink) {
+      struct iovec iov;
+      iov.iov_base = _stack.Bottom();
+      iov.iov_len = size();
+      int rv = sink.write(&iov, 1);
+      if (rv != 0) { _err = rv; }
+      _discardCompleted();
+    }
+
+    static void _addSegment(struct iovec *iov, int &iovcnt, const uint8_t *ptr, size_t len) {
+      if (len == 0) { return; }
+      iov[iovcnt].iov_base = (void *)ptr;
+      iov[iovcnt].iov_len = len;
+      iovcnt++;
+    }
+
+    bool _isValidHandle(FieldHandle h) const {
+      return (h >= 0 && (size_t)h < _fields.size());
+    }
+
+    /*
+     * returns handle of field in current table, -1 if not defined.
+     */
+    FieldHandle _findFieldHandle(const SPFieldDef &fieldDef) const {
 
       auto fit = _fieldMap.find(fieldDef);
       if (fit != _fieldMap.end()) {
         return fit->second;
       }
 
-      return SPFieldInfo();
+      return -1;
+    }
+
+    /*
+     * returns handle of field, defining it if needed.  -1 if fieldDef not set.
+     */
+    FieldHandle _getFieldHandle(const SPFieldDef &fieldDef) {
+      if (!fieldDef) {
+        return -1;
+      }
+      FieldHandle h = _findFieldHandle(fieldDef);
+      if (h < 0) {
+        h = _newFieldHandle(fieldDef);
+      }
+      return h;
     }
 
-    SPFieldInfo _newFieldInfo(const SPFieldDef fieldDef, uint32_t fixedSize = 0) {
-      SPFieldInfo field;
-      field = std::make_shared<FieldInfo>(fieldDef, (uint8_t)_fieldMap.size(), fixedSize);
-      _fieldMap[fieldDef] = field;
-      return field;
+    FieldHandle _newFieldHandle(const SPFieldDef &fieldDef, uint32_t fixedSize = 0) {
+      FieldHandle h = (FieldHandle)_fields.size();
+      _fields.push_back(FieldInfo(fieldDef, (uint8_t)h, fixedSize));
+      _fieldMap[fieldDef] = h;
+      return h;
     }
 
-    void _write(const SPFieldInfo field, DynVal value) {
+    void _write(const FieldInfo &field, DynVal value) {
 
-      switch (field->typeId){
+      switch (field.typeId){
         case TINT8: {
           uint8_t* ptr = staq().Push(1);
           *ptr = (uint8_t)value.as_i8();
@@ -282,7 +799,8 @@ virtual int put(const DynMap &obj) override {
         case TFLOAT32:
           writeFixed32(EncodeFloat(value.as_float()), staq());
           break;
-        case TSTRING: {
+        case TSTRING:
+        case TBYTES: {
           std::string s = value.as_s();
           writeVarInt(s.length(), staq());
           memcpy(staq().Push(s.length()), s.c_str(), s.length());
@@ -294,6 +812,83 @@ virtual int put(const DynMap &obj) override {
       }
     }
 
+    /*
+     * Writes a native numeric value, converted to the field type.
+     * String and bytes columns go through DynVal for the conversion.
+     */
+    template<typename T>
+    int _putNumber(FieldHandle h, T value) {
+      if (!_isValidHandle(h)) {
+        return -1;
+      }
+      FieldInfo &field = _fields[h];
+
+      if (field.typeId == TSTRING || field.typeId == TBYTES) {
+        return put(h, DynVal(value));
+      }
+
+      writeIndexTag(field);
+
+      switch (field.typeId){
+        case TINT8:
+          *(staq().Push(1)) = (uint8_t)(int8_t)value;
+          break;
+        case TUINT8:
+          *(staq().Push(1)) = (uint8_t)value;
+          break;
+        case TINT16:
+          writeVarInt(ZigZagEncode32((int16_t)value), staq());
+          break;
+        case TUINT16:
+          writeVarInt((uint16_t)value, staq());
+          break;
+        case TINT32:
+          writeVarInt(ZigZagEncode32((int32_t)value), staq());
+          break;
+        case TUINT32:
+          writeVarInt((uint32_t)value, staq());
+          break;
+        case TINT64:
+          writeVarInt(ZigZagEncode64((int64_t)value), staq());
+          break;
+        case TUINT64:
+          writeVarInt((uint64_t)value, staq());
+          break;
+        case TFLOAT64:
+          writeFixed64(EncodeDouble((double)value), staq());
+          break;
+        case TFLOAT32:
+          writeFixed32(EncodeFloat((float)value), staq());
+          break;
+        default:
+          assert(false);
+          break;
+      }
+      return 0;
+    }
+
+    /*
+     * Writes a length-delimited value straight from the caller's buffer.
+     * Numeric columns go through DynVal for the conversion.
+     */
+    int _putBytes(FieldHandle h, const void *src, size_t len) {
+      if (!_isValidHandle(h)) {
+        return -1;
+      }
+      FieldInfo &field = _fields[h];
+
+      if (field.typeId != TSTRING && field.typeId != TBYTES) {
+        return put(h, DynVal(std::string((const char *)src, len)));
+      }
+
+      writeIndexTag(field);
+      writeVarInt(len, staq());
+      if (len > 0) {
+        memcpy(staq().Push(len), src, len);
+      }
+      return 0;
+    }
+
     void writeFixed64(uint64_t value, Stack &stack) {
       union { uint64_t ival; uint8_t bytes[8];};
       ival = value;
@@ -305,91 +900,91 @@ virtual int put(const DynMap &obj) override {
       memcpy(stack.Push(sizeof(value)), bytes, sizeof(bytes));
     }
 
-    void writeHeaderTag(const SPFieldInfo field) {
-      if (field->isWritten) { return; }
+    void writeHeaderTag(FieldInfo &field) {
+      if (field.isWritten) { return; }
 
       Stack &stack = _hdrStack;
-      size_t namelen = field->name.length();
+      size_t namelen = field.name.length();
 
       uint8_t tagbyte = CrowTag::THFIELD;
-      if (field->schema && field->schema->id > 0) { tagbyte |= FIELDINFO_FLAG_HAS_SUBID; }
+      if (field.schema && field.schema->id > 0) { tagbyte |= FIELDINFO_FLAG_HAS_SUBID; }
       if (namelen > 0) { tagbyte |= FIELDINFO_FLAG_HAS_NAME; }
-      if (field->isStructField()) { tagbyte |= FIELDINFO_FLAG_RAW; }
+      if (field.isStructField()) { tagbyte |= FIELDINFO_FLAG_RAW; }
 
       uint8_t* ptr = stack.Push(2);
       *ptr++ = tagbyte;
-      *ptr++ = field->index;
+      *ptr++ = field.index;
 
       // typeid
       ptr = stack.Push(1);
-      ptr[0] = field->typeId;
+      ptr[0] = field.typeId;
 
       // id and subid (if set)
-      writeVarInt(field->id, stack);
-      if (field->schema && field->schema->id > 0) { writeVarInt(field->schema->id, stack); }
+      writeVarInt(field.id, stack);
+      if (field.schema && field.schema->id > 0) { writeVarInt(field.schema->id, stack); }
 
       // name (if set)
       if (namelen > 0) {
         writeVarInt(namelen, stack);
         ptr = stack.Push(namelen);
-        memcpy(ptr,field->name.c_str(),namelen);
+        memcpy(ptr,field.name.c_str(),namelen);
       }
 
-      if (field->isStructField()) {
-        writeVarInt(field->structFieldLength, stack);
+      // fixed length of struct field, only needed for variable sized types
+      if (field.isStructField() && (field.typeId == TSTRING || field.typeId == TBYTES)) {
+        writeVarInt(field.structFieldLength, stack);
       }
       // mark as written, so we dont write FIELDINFO more than once
-      field->isWritten = true;
+      field.isWritten = true;
       //((Field*)pField)->_written = true;
     }
 
     /*
      * one byte 0x80 | index
      */
-    void writeIndexTag(const SPFieldInfo field) {
-
-      if (field->isWritten) {
-
-        Stack &stack = _dataStack;
-        uint8_t* ptr = stack.Push(1);
-        ptr[0] = field->index | UPPER_BIT;
+    void writeIndexTag(FieldInfo &field) {
 
-      } else {
+      if (!field.isWritten) {
         writeHeaderTag(field);
-        if (!field->isStructField()) {
-          // field index on data row
-          uint8_t* ptr = _dataStack.Push(1);
-          ptr[0] = field->index | UPPER_BIT;
-        }
+        if (field.isStructField()) { return; }
       }
-    }
 
-    size_t writeVarInt(uint64_t value, Stack &stack) {
-      size_t i=0;
-      while (true) {
-        i++;
-        uint8_t b = (uint8_t)(value & 0x07F);
-        value = value >> 7;
-        if (0L == value) {
-          uint8_t* ptr = stack.Push(1);
-          *ptr = b;
-          break;
-        }
-        uint8_t* p = stack.Push(1);
-        *p = (b | 0x80u);
-      }
+      // field index on data row
+      _openRow();
+      uint8_t* ptr = staq().Push(1);
+      ptr[0] = field.index | UPPER_BIT;
+    }
 
-      return i;
+    /*
+     * Reserves room for the longest varint once, then encodes in place.
+     */
+    _ATTRINLINE_ size_t writeVarInt(uint64_t value, Stack &stack) {
+      stack.Reserve(MAX_VARINT_LEN);
+      size_t len = encodeVarInt(value, stack.Top());
+      stack.PushUnsafe(len);
+      return len;
     }
 
     Stack _stack, _dataStack, _hdrStack;
-    std::map<const SPFieldDef, SPFieldInfo> _fieldMap;
-    std::vector<SPFieldInfo> _fields;
-    std::vector<SPFieldInfo> _structFields;
+    bool   _rowOpen;
+    size_t _rowStart;
+    int    _err;
+    FlushPolicy _policy;
+    uint32_t    _pendingRows;
+    std::chrono::steady_clock::time_point _pendingSince;
+    std::map<SPFieldDef, FieldHandle> _fieldMap;
+    std::vector<FieldInfo> _fields;           // indexed by FieldHandle
+    std::vector<FieldHandle> _structFields;
     bool   _haveStructData;
     size_t _structLen;
     bool   _structDefFinalized;
     Stack  _structBuf;
+    bool   _framed;          // TABLE_FLAG_FRAMED set on current table
+    uint8_t _tableFlags;
+    BlockPolicy _blockPolicy;
+    bool   _blockOpen;
+    size_t _blockStart;      // offset of TBLOCK in _stack
+    uint32_t _blockRows;
   };
 
   class EncoderFactory {
@@ -397,5 +992,141 @@ virtual int put(const DynMap &obj) override {
     static Encoder* New(size_t initialCapacity = 4096) { return new EncoderImpl(initialCapacity); }
   };
 
+  /*
+   * Recycles encoders, keeping their grown buffers.  Free lists are
+   * thread-local, so Acquire() and Release() take no locks.  An encoder
+   * released on another thread joins that thread's free list.
+   */
+  class EncoderPool {
+  public:
+    static const size_t MAX_PER_THREAD = 8;
+
+    struct Releaser {
+      void operator()(Encoder *pEnc) const { Release(pEnc); }
+    };
+    typedef std::unique_ptr<Encoder, Releaser> Ptr;
+
+    /*
+     * returns cleared encoder from this thread's free list, or a new one.
+     */
+    static Encoder* Acquire(size_t initialCapacity = 4096) {
+      FreeList &list = freeList();
+      if (!list.encoders.empty()) {
+        Encoder *pEnc = list.encoders.back();
+        list.encoders.pop_back();
+        return pEnc;
+      }
+      return EncoderFactory::New(initialCapacity);
+    }
+
+    static Ptr AcquirePtr(size_t initialCapacity = 4096) { return Ptr(Acquire(initialCapacity)); }
+
+    /*
+     * Clears encoder and returns it to this thread's free list.
+     * pEnc must come from Acquire() or EncoderFactory::New().
+     */
+    static void Release(Encoder *pEnc) {
+      if (pEnc == nullptr) { return; }
+      pEnc->clear();
+      pEnc->setFlushPolicy(FlushPolicy());
+      pEnc->setBlockPolicy(BlockPolicy());
+      FreeList &list = freeList();
+      if (list.encoders.size() < MAX_PER_THREAD) {
+        list.encoders.push_back(pEnc);
+      } else {
+        delete pEnc;
+      }
+    }
+
+  private:
+    struct FreeList {
+      std::vector<Encoder*> encoders;
+      ~FreeList() { for (auto p : encoders) delete p; }
+    };
+
+    static FreeList& freeList() {
+      static thread_local FreeList list;
+      return list;
+    }
+  };
+
+  /*
+   * Encodes rows from many threads into one block framed output.  Each
+   * producer thread owns a shard, an encoder with a block policy, so
+   * put() takes no locks.  Shards append finished blocks to the target
+   * in the order they complete, taking the sink lock once per block.
+   *
+   *   ShardedEncoder sharded(sink);
+   *
+   *   // on each producer thread
+   *   Encoder *enc = sharded.newShard();
+   *   enc->put(NAME, "bob");
+   *   enc->endRow(sharded.sink());
+   *
+   *   // once producers are done
+   *   sharded.close();
+   *
+   * Rows of a shard stay in order.  Rows of different shards are
+   * interleaved a block at a time.
+   */
+  class ShardedEncoder {
+  public:
+    static const size_t DEFAULT_BLOCK_SIZE = 1024 * 1024;
+
+    ShardedEncoder(Sink &target, const BlockPolicy &policy = BlockPolicy(0, DEFAULT_BLOCK_SIZE)) :
+      _collector(target), _policy(policy), _mutex(), _shards() {
+      if (!_policy.enabled()) {
+        throw new std::invalid_argument("ShardedEncoder needs a block policy");
+      }
+    }
+
+    ~ShardedEncoder() {
+      close();
+      for (auto p : _shards) { delete p; }
+    }
+
+    /*
+     * returns encoder for use by one thread.  Owned by ShardedEncoder.
+     */
+    Encoder* newShard(size_t initialCapacity = 65536) {
+      Encoder *pEnc = EncoderFactory::New(initialCapacity);
+      pEnc->setBlockPolicy(_policy);
+      std::lock_guard<std::mutex> lock(_mutex);
+      _shards.push_back(pEnc);
+      return pEnc;
+    }
+
+    /*
+     * Sink for endRow() and sync() of shards.
+     */
+    Sink& sink() { return _collector; }
+
+    /*
+     * Write the open block of every shard.  Call once producers are
+     * done with their shards.
+     */
+    void close() {
+      std::lock_guard<std::mutex> lock(_mutex);
+      for (auto p : _shards) { p->sync(_collector); }
+    }
+
+    size_t numShards() const {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _shards.size();
+    }
+
+    /*
+     * returns 0 if no error, otherwise code from errno.h of the last
+     * failed write to target.
+     */
+    int getErrCode() const { return _collector.getErrCode(); }
+
+  private:
+    CollectorSink          _collector;
+    BlockPolicy            _policy;
+    mutable std::mutex     _mutex;
+    std::vector<Encoder*>  _shards;
+  };
+
 }
 #endif // _CROW_ENCODE_IMPL_HPP_
@@ -0,0 +1,313 @@
+#ifndef _CROW_SINK_IMPL_HPP_
+#define _CROW_SINK_IMPL_HPP_
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../crow_sink.hpp"
+#include "stack.hpp"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+namespace crow {
+
+  /*
+   * Writes to a file descriptor using writev.  Short writes are resumed,
+   * EINTR is retried, and non-blocking descriptors are polled until
+   * writable, so no bytes are dropped.
+   */
+  class FdSink : public Sink {
+  public:
+    FdSink(int fd) : Sink(), _fd(fd) {}
+
+    int write(const struct iovec *iov, int iovcnt) override {
+      struct iovec vec[IOV_MAX];
+
+      while (iovcnt > 0) {
+
+        // skip empty segments, copy up to IOV_MAX so we can advance partial writes
+
+        while (iovcnt > 0 && iov->iov_len == 0) { iov++; iovcnt--; }
+        int n = (iovcnt < IOV_MAX ? iovcnt : IOV_MAX);
+        if (n == 0) break;
+        memcpy(vec, iov, n * sizeof(struct iovec));
+        iov += n;
+        iovcnt -= n;
+
+        struct iovec *pv = vec;
+        while (n > 0) {
+          ssize_t rv = ::writev(_fd, pv, n);
+          if (rv < 0) {
+            if (errno == EINTR) { continue; }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+              if (_waitWritable()) { continue; }
+            }
+            return errno;
+          }
+
+          // advance past written bytes
+
+          size_t written = (size_t)rv;
+          while (n > 0 && written >= pv->iov_len) {
+            written -= pv->iov_len;
+            pv++;
+            n--;
+          }
+          if (n > 0) {
+            pv->iov_base = (uint8_t *)pv->iov_base + written;
+            pv->iov_len -= written;
+          }
+        }
+      }
+      return 0;
+    }
+
+    int fd() const { return _fd; }
+
+  private:
+
+    bool _waitWritable() {
+      struct pollfd pfd;
+      pfd.fd = _fd;
+      pfd.events = POLLOUT;
+      pfd.revents = 0;
+      while (true) {
+        int rv = ::poll(&pfd, 1, -1);
+        if (rv > 0) { return true; }
+        if (rv < 0 && errno != EINTR) { return false; }
+      }
+    }
+
+    int _fd;
+  };
+
+  /*
+   * Accumulates output in memory.
+   */
+  class MemorySink : public Sink {
+  public:
+    MemorySink(size_t initialCapacity = 4096) : Sink(), _stack(initialCapacity) {}
+
+    int write(const struct iovec *iov, int iovcnt) override {
+      for (int i=0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0) { continue; }
+        memcpy(_stack.Push(iov[i].iov_len), iov[i].iov_base, iov[i].iov_len);
+      }
+      return 0;
+    }
+
+    const uint8_t* data() const { return _stack.Bottom(); }
+    size_t size() const { return _stack.GetSize(); }
+    void clear() { _stack.Clear(); }
+
+  private:
+    Stack _stack;
+  };
+
+  /*
+   * Calls fn for each non-empty segment.  fn returns 0 on success,
+   * otherwise an errno code, which stops the write.
+   */
+  class CallbackSink : public Sink {
+  public:
+    typedef std::function<int(const uint8_t *data, size_t len)> Callback;
+
+    CallbackSink(Callback fn) : Sink(), _fn(fn) {}
+
+    int write(const struct iovec *iov, int iovcnt) override {
+      for (int i=0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0) { continue; }
+        int rv = _fn((const uint8_t *)iov[i].iov_base, iov[i].iov_len);
+        if (rv != 0) { return rv; }
+      }
+      return 0;
+    }
+
+  private:
+    Callback _fn;
+  };
+
+  /*
+   * Writes to target sink on a background thread.
+   *
+   * The encoder swaps its completed output buffer for an empty one and
+   * keeps encoding while the I/O thread drains the full one.  At most
+   * maxQueued buffers wait for the I/O thread; ready() returns false
+   * while the queue is full, so the encoder keeps batching rows instead
+   * of blocking, up to FlushPolicy::maxBufferedBytes.  Writes past that,
+   * and sync() and flush(), block until there is room.
+   * Errors from the target are reported by getErrCode().
+   */
+  class AsyncSink : public Sink {
+  public:
+    AsyncSink(Sink &target, size_t maxQueued = 2, size_t bufferCapacity = 65536) : Sink(),
+      _target(target), _maxQueued(maxQueued > 0 ? maxQueued : 1), _bufferCapacity(bufferCapacity),
+      _mutex(), _cond(), _queue(), _free(), _busy(false), _stop(false), _err(0),
+      _thread(&AsyncSink::_run, this) {
+    }
+
+    ~AsyncSink() {
+      close();
+      for (auto p : _free) { delete p; }
+    }
+
+    int write(const struct iovec *iov, int iovcnt) override {
+      std::unique_lock<std::mutex> lock(_mutex);
+      if (_stop) { return EPIPE; }
+      Stack *buf = _waitFree(lock);
+      for (int i=0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0) { continue; }
+        memcpy(buf->Push(iov[i].iov_len), iov[i].iov_base, iov[i].iov_len);
+      }
+      _queue.push_back(buf);
+      _cond.notify_all();
+      return _err;
+    }
+
+    bool swap(Stack &buffer) override {
+      std::unique_lock<std::mutex> lock(_mutex);
+      if (_stop) { return false; }
+      Stack *buf = _waitFree(lock);
+      buf->Swap(buffer);
+      _queue.push_back(buf);
+      _cond.notify_all();
+      return true;
+    }
+
+    bool ready() const override {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _queue.size() < _maxQueued;
+    }
+
+    /*
+     * Wait until all queued buffers are written.
+     */
+    void drain() {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _cond.wait(lock, [this] { return _queue.empty() && !_busy; });
+    }
+
+    /*
+     * Write queued buffers and stop I/O thread.
+     */
+    void close() {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_stop) { return; }
+        _stop = true;
+        _cond.notify_all();
+      }
+      _thread.join();
+    }
+
+    size_t queued() const {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _queue.size();
+    }
+
+    int getErrCode() const {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _err;
+    }
+
+  private:
+
+    /*
+     * Returns an empty buffer, waiting while the queue is full.
+     */
+    Stack* _waitFree(std::unique_lock<std::mutex> &lock) {
+      _cond.wait(lock, [this] { return _queue.size() < _maxQueued; });
+      if (_free.empty()) {
+        return new Stack(_bufferCapacity);
+      }
+      Stack *buf = _free.back();
+      _free.pop_back();
+      return buf;
+    }
+
+    void _run() {
+      std::unique_lock<std::mutex> lock(_mutex);
+      while (true) {
+        _cond.wait(lock, [this] { return _stop || !_queue.empty(); });
+        if (_queue.empty()) { break; }  // stopped and drained
+
+        Stack *buf = _queue.front();
+        _queue.pop_front();
+        _busy = true;
+        lock.unlock();
+
+        struct iovec iov;
+        iov.iov_base = buf->Bottom();
+        iov.iov_len = buf->GetSize();
+        int rv = (iov.iov_len > 0 ? _target.write(&iov, 1) : 0);
+        buf->Clear();
+
+        lock.lock();
+        if (rv != 0) { _err = rv; }
+        _free.push_back(buf);
+        _busy = false;
+        _cond.notify_all();
+      }
+    }
+
+    Sink                          &_target;
+    size_t                         _maxQueued;
+    size_t                         _bufferCapacity;
+    mutable std::mutex             _mutex;
+    std::condition_variable        _cond;
+    std::deque<Stack*>             _queue;
+    std::vector<Stack*>            _free;
+    bool                           _busy;
+    bool                           _stop;
+    int                            _err;
+    std::thread                    _thread;
+  };
+
+  /*
+   * Lets encoders on several threads write to one target sink.  Each
+   * write() goes to the target whole, under a lock, so writes never
+   * interleave.  Encoders with a block policy write whole blocks, so
+   * the target gets complete blocks in the order they were finished.
+   */
+  class CollectorSink : public Sink {
+  public:
+    CollectorSink(Sink &target) : Sink(), _target(target), _mutex(), _err(0) {}
+
+    int write(const struct iovec *iov, int iovcnt) override {
+      size_t len = 0;
+      for (int i=0; i < iovcnt; i++) { len += iov[i].iov_len; }
+      if (len == 0) { return 0; }
+
+      std::lock_guard<std::mutex> lock(_mutex);
+      int rv = _target.write(iov, iovcnt);
+      if (rv != 0) { _err = rv; }
+      return rv;
+    }
+
+    bool ready() const override { return _target.ready(); }
+
+    int getErrCode() const {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _err;
+    }
+
+  private:
+    Sink                &_target;
+    mutable std::mutex   _mutex;
+    int                  _err;
+  };
+
+} // namespace crow
+
+#endif // _CROW_SINK_IMPL_HPP_
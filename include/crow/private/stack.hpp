@@ -1,8 +1,11 @@
 #ifndef _SIMPLEPB_STACK_HPP_
 #define _SIMPLEPB_STACK_HPP_
 
-// This is an adaptation of RapidJson's very well implemented internal/stack.
-// simplified without allocator and only for uint8_t
+// This is an adaptation of RapidJson's very well implemented internal/stack,
+// only for uint8_t, with its own allocation in place of the allocator:
+// small buffers come from a thread-local arena, mid sized from malloc, and
+// large ones are mmap'd and grown with mremap.  Capacity is trimmed back
+// when usage drops.
 
 // Tencent is pleased to support the open source community by making RapidJSON available.
 //
@@ -47,16 +50,127 @@
 #endif
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <algorithm>
+#include <vector>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Stacks up to this capacity use the thread-local arena
+#ifndef CROW_STACK_ARENA_MAX
+#define CROW_STACK_ARENA_MAX  (64 * 1024)
+#endif
+
+// Stacks from this capacity are mmap'd and grown with mremap (linux only)
+#ifndef CROW_STACK_MMAP_MIN
+#define CROW_STACK_MMAP_MIN   (1024 * 1024)
+#endif
+
+// Define CROW_STACK_HUGEPAGES to request transparent huge pages for mmap'd stacks
 
 namespace crow {
+
+  /*
+   * Thread-local cache of small buffers in power of two size classes.
+   * Freed blocks are kept for reuse by the next Stack allocated or grown
+   * on the same thread, instead of going back to malloc.
+   */
+  class StackArena {
+  public:
+    static const size_t MIN_CLASS = 256;
+    static const size_t MAX_CACHED = 8;    // blocks per size class
+
+    static size_t RoundUp(size_t n) {
+      size_t c = MIN_CLASS;
+      while (c < n) c <<= 1;
+      return c;
+    }
+
+    static uint8_t* Alloc(size_t capacity) {
+      Cache *pCache = cache();
+      if (pCache != nullptr) {
+        std::vector<uint8_t*> &list = pCache->lists[ClassIndex(capacity)];
+        if (!list.empty()) {
+          uint8_t *p = list.back();
+          list.pop_back();
+          return p;
+        }
+      }
+      return static_cast<uint8_t*>(malloc(capacity));
+    }
+
+    static void Free(uint8_t* p, size_t capacity) {
+      Cache *pCache = cache();
+      if (pCache != nullptr) {
+        std::vector<uint8_t*> &list = pCache->lists[ClassIndex(capacity)];
+        if (list.size() < MAX_CACHED) {
+          list.push_back(p);
+          return;
+        }
+      }
+      free(p);
+    }
+
+  private:
+    static const int NUM_CLASSES = 24;
+
+    static int ClassIndex(size_t capacity) {
+      int i = 0;
+      while ((MIN_CLASS << i) < capacity) i++;
+      assert(i < NUM_CLASSES);
+      return i;
+    }
+
+    struct Cache {
+      std::vector<uint8_t*> lists[NUM_CLASSES];
+      ~Cache() {
+        for (int i=0; i < NUM_CLASSES; i++) {
+          for (auto p : lists[i]) free(p);
+        }
+      }
+    };
+
+    /*
+     * returns nullptr once the thread's cache is destroyed, so stacks
+     * freed later during thread exit go straight to free().
+     */
+    static Cache* cache() {
+      static thread_local bool destroyed = false;
+      if (destroyed) return nullptr;
+
+      struct Owner {
+        Cache cache;
+        bool &destroyed;
+        Owner(bool &flag) : cache(), destroyed(flag) {}
+        ~Owner() { destroyed = true; }
+      };
+      static thread_local Owner owner(destroyed);
+      return &owner.cache;
+    }
+  };
+
+  /*
+   * Growable byte buffer used for encoder output.  Buffers come from
+   * StackArena, malloc or mmap depending on capacity; every TRIM_INTERVAL
+   * clears, capacity well above recent peak usage is released.
+   */
   class Stack {
   public:
     // Optimization note: Do not allocate memory for stack_ in constructor.
     // Do it lazily when first Push() -> Expand() -> Resize().
-    Stack(size_t stackCapacity) : stack_(0), stackTop_(0), stackEnd_(0), initialCapacity_(stackCapacity) {
+    Stack(size_t stackCapacity) : stack_(0), stackTop_(0), stackEnd_(0), initialCapacity_(stackCapacity),
+      kind_(NONE), peak_(0), numClears_(0) {
     }
-    ~Stack() { if (stack_ != nullptr) free(stack_); }
+    ~Stack() { Deallocate(stack_, kind_, GetCapacity()); }
+
+    Stack(const Stack&) = delete;
+    Stack& operator=(const Stack&) = delete;
 
     // Optimization note: try to minimize the size of this function for force inline.
     // Expansion is run very infrequently, so it is moved to another (probably non-inline) function.
@@ -78,7 +192,32 @@ namespace crow {
         return ret;
     }
 
-    void Clear() { stackTop_ = stack_; }
+    _ATTRINLINE_ void Pop(size_t count) {
+        assert(GetSize() >= count);
+        stackTop_ -= count;
+    }
+
+    _ATTRINLINE_ uint8_t* Top() { return stackTop_; }
+
+    // Capacity follows observed usage: every TRIM_INTERVAL clears, a
+    // buffer much larger than the recent peak is shrunk, so one large
+    // spike does not pin memory for the life of the stack.
+    void Clear() {
+        peak_ = std::max(peak_, GetSize());
+        stackTop_ = stack_;
+        if (BRANCH_UNLIKELY_(++numClears_ >= TRIM_INTERVAL))
+            Trim();
+    }
+
+    void Swap(Stack& rhs) {
+        std::swap(stack_, rhs.stack_);
+        std::swap(stackTop_, rhs.stackTop_);
+        std::swap(stackEnd_, rhs.stackEnd_);
+        std::swap(initialCapacity_, rhs.initialCapacity_);
+        std::swap(kind_, rhs.kind_);
+        std::swap(peak_, rhs.peak_);
+        std::swap(numClears_, rhs.numClears_);
+    }
 
     uint8_t* Bottom() { return reinterpret_cast<uint8_t*>(stack_); }
 
@@ -106,22 +245,112 @@ namespace crow {
         Resize(newCapacity);
     }
 
+    static const uint32_t TRIM_INTERVAL = 64;
+
+    enum Kind { NONE, ARENA, HEAP, MAPPED };
+
+    static Kind KindFor(size_t capacity) {
+        if (capacity <= CROW_STACK_ARENA_MAX) return ARENA;
+#ifdef __linux__
+        if (capacity >= CROW_STACK_MMAP_MIN) return MAPPED;
+#endif
+        return HEAP;
+    }
+
+    static size_t RoundCapacity(size_t capacity, Kind kind) {
+        if (kind == ARENA) return StackArena::RoundUp(capacity);
+#ifdef __linux__
+        if (kind == MAPPED) {
+            size_t page = (size_t)sysconf(_SC_PAGESIZE);
+            return (capacity + page - 1) & ~(page - 1);
+        }
+#endif
+        return capacity;
+    }
+
+    static uint8_t* Allocate(size_t capacity, Kind kind) {
+        switch (kind) {
+            case ARENA: return StackArena::Alloc(capacity);
+            case HEAP: return static_cast<uint8_t*>(malloc(capacity));
+#ifdef __linux__
+            case MAPPED: {
+                void *p = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (p == MAP_FAILED) return nullptr;
+                AdviseHugePages(p, capacity);
+                return static_cast<uint8_t*>(p);
+            }
+#endif
+            default: return nullptr;
+        }
+    }
+
+    static void Deallocate(uint8_t *p, Kind kind, size_t capacity) {
+        if (p == nullptr) return;
+        switch (kind) {
+            case ARENA: StackArena::Free(p, capacity); break;
+            case HEAP: free(p); break;
+#ifdef __linux__
+            case MAPPED: munmap(p, capacity); break;
+#endif
+            default: break;
+        }
+    }
+
+    static void AdviseHugePages(void *p, size_t capacity) {
+#if defined(CROW_STACK_HUGEPAGES) && defined(MADV_HUGEPAGE)
+        if (capacity >= 2 * 1024 * 1024) madvise(p, capacity, MADV_HUGEPAGE);
+#endif
+    }
+
     void Resize(size_t newCapacity) {
         const size_t size = GetSize();  // Backup the current size
+        const size_t oldCapacity = GetCapacity();
+        Kind kind = KindFor(newCapacity);
+        newCapacity = RoundCapacity(newCapacity, kind);
 
-        uint8_t* pOld = stack_;
-        //printf("Resize %lu -> %lu\n", size, newCapacity);
-        stack_ = static_cast<uint8_t*>(malloc(newCapacity));
-        memcpy(stack_, pOld, size);
+        uint8_t* p = nullptr;
+        if (kind == HEAP && kind_ == HEAP) {
+            p = static_cast<uint8_t*>(realloc(stack_, newCapacity));
+#ifdef __linux__
+        } else if (kind == MAPPED && kind_ == MAPPED) {
+            // grows in place, or moves page mappings without copying
+            void *vp = mremap(stack_, oldCapacity, newCapacity, MREMAP_MAYMOVE);
+            if (vp != MAP_FAILED) {
+                p = static_cast<uint8_t*>(vp);
+                AdviseHugePages(p, newCapacity);
+            }
+#endif
+        } else {
+            p = Allocate(newCapacity, kind);
+            if (p != nullptr) {
+                if (size > 0) memcpy(p, stack_, size);
+                Deallocate(stack_, kind_, oldCapacity);
+            }
+        }
+        if (p == nullptr) throw std::bad_alloc();
 
+        stack_ = p;
+        kind_ = kind;
         stackTop_ = stack_ + size;
         stackEnd_ = stack_ + newCapacity;
     }
 
+    void Trim() {
+        size_t target = std::max(initialCapacity_, peak_ + peak_ / 2);
+        if (stack_ != 0 && GetCapacity() > 4 * target && GetCapacity() > CROW_STACK_ARENA_MAX) {
+            Resize(std::max(target, GetSize()));
+        }
+        peak_ = 0;
+        numClears_ = 0;
+    }
+
     uint8_t *stack_;
     uint8_t *stackTop_;
     uint8_t *stackEnd_;
     size_t initialCapacity_;
+    Kind kind_;
+    size_t peak_;          // largest size since last Trim
+    uint32_t numClears_;
   };
 }
 
@@ -0,0 +1,167 @@
+#ifndef _CROW_VARINT_HPP_
+#define _CROW_VARINT_HPP_
+
+#include <stdint.h>
+#include <string.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define CROW_VARINT_X86 1
+#include <immintrin.h>
+#else
+#define CROW_VARINT_X86 0
+#endif
+
+#define MAX_VARINT_LEN 10
+
+namespace crow {
+
+  /*
+   * CPU features used to select varint kernels, detected once at startup.
+   * fastPdep covers both pdep and pext.
+   * Until detection runs (static init order), all flags read false and
+   * the portable kernels are used.
+   */
+  template<int N>
+  struct CpuFeaturesT {
+    static const bool fastPdep;
+
+    static bool detect() {
+#if CROW_VARINT_X86
+      __builtin_cpu_init();
+      // pdep is microcoded and very slow on AMD before Zen 3
+      return __builtin_cpu_supports("bmi2") &&
+        !__builtin_cpu_is("amdfam15h") && !__builtin_cpu_is("znver1") &&
+        !__builtin_cpu_is("znver2");
+#else
+      return false;
+#endif
+    }
+  };
+  template<int N> const bool CpuFeaturesT<N>::fastPdep = CpuFeaturesT<N>::detect();
+
+  typedef CpuFeaturesT<0> CpuFeatures;
+
+  /*
+   * returns number of bytes needed to encode value as varint.
+   */
+  inline size_t varIntSize(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    size_t bits = 64 - __builtin_clzll(value | 1);
+    return (bits + 6) / 7;
+#else
+    size_t len = 1;
+    while (value >= 0x80) { value >>= 7; len++; }
+    return len;
+#endif
+  }
+
+  inline size_t encodeVarIntScalar(uint64_t value, uint8_t *dest) {
+    size_t i=0;
+    while (value >= 0x80) {
+      dest[i++] = (uint8_t)(value | 0x80);
+      value >>= 7;
+    }
+    dest[i++] = (uint8_t)value;
+    return i;
+  }
+
+#if CROW_VARINT_X86
+  /*
+   * Spreads 7-bit groups into bytes with one pdep and a single 8 byte
+   * store.  Values needing more than 8 bytes use the scalar loop.
+   * dest must have room for 8 bytes.
+   */
+  __attribute__((target("bmi2")))
+  inline size_t encodeVarIntPdep(uint64_t value, uint8_t *dest) {
+    if (value >= (1ULL << 56)) {
+      return encodeVarIntScalar(value, dest);
+    }
+    size_t len = varIntSize(value);
+    uint64_t x = _pdep_u64(value, 0x7f7f7f7f7f7f7f7fULL);
+    x |= 0x8080808080808080ULL & ((1ULL << (8 * (len - 1))) - 1);
+    memcpy(dest, &x, sizeof(x));
+    return len;
+  }
+#endif
+
+  /*
+   * encode value into dest, which must have room for MAX_VARINT_LEN bytes.
+   * returns number of bytes written.
+   */
+  inline size_t encodeVarInt(uint64_t value, uint8_t *dest) {
+    if (value < 0x80) {
+      *dest = (uint8_t)value;
+      return 1;
+    }
+#if CROW_VARINT_X86
+    if (CpuFeatures::fastPdep) {
+      return encodeVarIntPdep(value, dest);
+    }
+#endif
+    return encodeVarIntScalar(value, dest);
+  }
+
+  /*
+   * Unrolled decode without bounds checks.  At least MAX_VARINT_LEN
+   * bytes must be readable at p.  Varints longer than MAX_VARINT_LEN
+   * are cut off at MAX_VARINT_LEN bytes.
+   * returns number of bytes consumed.
+   */
+  inline size_t decodeVarIntScalar(const uint8_t *p, uint64_t &value) {
+    uint64_t b;
+    b = p[0]; value = b & 0x7F;          if (b < 0x80) return 1;
+    b = p[1]; value |= (b & 0x7F) << 7;  if (b < 0x80) return 2;
+    b = p[2]; value |= (b & 0x7F) << 14; if (b < 0x80) return 3;
+    b = p[3]; value |= (b & 0x7F) << 21; if (b < 0x80) return 4;
+    b = p[4]; value |= (b & 0x7F) << 28; if (b < 0x80) return 5;
+    b = p[5]; value |= (b & 0x7F) << 35; if (b < 0x80) return 6;
+    b = p[6]; value |= (b & 0x7F) << 42; if (b < 0x80) return 7;
+    b = p[7]; value |= (b & 0x7F) << 49; if (b < 0x80) return 8;
+    b = p[8]; value |= (b & 0x7F) << 56; if (b < 0x80) return 9;
+    b = p[9]; value |= (b & 0x01) << 63;
+    return 10;
+  }
+
+#if CROW_VARINT_X86
+  /*
+   * Finds the terminating byte of up to 16 bytes with one SSE2 movemask,
+   * in the style of Masked-VByte, then gathers the 7-bit groups of
+   * varints up to 8 bytes with a single pext.
+   * At least 16 bytes must be readable at p.
+   */
+  __attribute__((target("bmi2")))
+  inline size_t decodeVarIntPext(const uint8_t *p, uint64_t &value) {
+    __m128i block = _mm_loadu_si128((const __m128i *)p);
+    uint32_t more = (uint32_t)_mm_movemask_epi8(block);
+    size_t len = (size_t)__builtin_ctz(~more) + 1;
+    if (len > 8) {
+      return decodeVarIntScalar(p, value);
+    }
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    uint64_t mask = (len == 8 ? ~0ULL : ((1ULL << (8 * len)) - 1)) & 0x7f7f7f7f7f7f7f7fULL;
+    value = _pext_u64(x, mask);
+    return len;
+  }
+#endif
+
+  /*
+   * Fast path decode, used when at least 16 bytes remain in the buffer.
+   * returns number of bytes consumed.
+   */
+  inline size_t decodeVarIntFast(const uint8_t *p, uint64_t &value) {
+    if (*p < 0x80) {
+      value = *p;
+      return 1;
+    }
+#if CROW_VARINT_X86
+    if (CpuFeatures::fastPdep) {
+      return decodeVarIntPext(p, value);
+    }
+#endif
+    return decodeVarIntScalar(p, value);
+  }
+
+} // namespace crow
+
+#endif // _CROW_VARINT_HPP_
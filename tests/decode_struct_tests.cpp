@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include "../include/crow.hpp"
+#include "../include/crow/crow_columnar_decoder.hpp"
 #include "test_defs.hpp"
 
 class DecStructTest : public ::testing::Test {
@@ -46,3 +47,205 @@ TEST_F(DecStructTest, decodeStructAndVariable)
 
   delete pDec;
 }
+
+TEST_F(DecStructTest, columnarStructAndVariable)
+{
+  auto vec = std::vector<uint8_t>();
+  HexStringToVec("1300020a1301090b1302010c0343030100046e616d65051700000001426f62048302626f053e000000004d6f65068304626f626f053e000000004d6f6500", vec);
+
+  crow::ColumnarDecoderListener cols;
+  crow::DecoderImpl dec(vec.data(), vec.size());
+  dec.decode(cols);
+
+  ASSERT_EQ(3, cols.numRows());
+  ASSERT_EQ(4, cols.columns().size());
+
+  const crow::DecodedColumn *pAge = cols.column(0);
+  ASSERT_TRUE(pAge != nullptr);
+  ASSERT_EQ(std::vector<int32_t>({23, 62, 62}), pAge->i32);
+
+  const crow::DecodedColumn *pActive = cols.column(1);
+  ASSERT_EQ(std::vector<uint8_t>({1, 0, 0}), pActive->u8);
+
+  const crow::DecodedColumn *pStructName = cols.column(2);
+  ASSERT_TRUE(pStructName->str(0) == std::string("Bob"));
+  ASSERT_TRUE(pStructName->str(2) == std::string("Moe"));
+
+  // last row has no variable name
+
+  const crow::DecodedColumn *pName = cols.column(3);
+  ASSERT_EQ(3, pName->numRows);
+  ASSERT_TRUE(pName->isValid(0));
+  ASSERT_TRUE(pName->isValid(1));
+  ASSERT_FALSE(pName->isValid(2));
+  ASSERT_TRUE(pName->str(1) == std::string("bobo"));
+  ASSERT_EQ(0, pName->str(2).size());
+}
+
+// struct fields only, variable section is skipped
+TEST_F(DecStructTest, projectionSkipsVariable)
+{
+  auto vec = std::vector<uint8_t>();
+  HexStringToVec("1300020a1301090b1302010c0343030100046e616d65051700000001426f62048302626f053e000000004d6f65068304626f626f053e000000004d6f6500", vec);
+
+  auto dl = crow::GenericDecoderListener();
+  auto pDec = crow::DecoderFactory::New(vec.data(), vec.size());
+  pDec->setProjection(std::vector<uint32_t>({10}));
+  auto numRows = pDec->decode(dl);
+  ASSERT_EQ(3, numRows);
+  ASSERT_EQ(0, dl._rows.size());
+  ASSERT_EQ(3, dl._structData.size());
+
+  delete pDec;
+}
+
+// struct predicate is checked on struct bytes, variable one on the varlen section
+TEST_F(DecStructTest, predicates)
+{
+  auto vec = std::vector<uint8_t>();
+  HexStringToVec("1300020a1301090b1302010c0343030100046e616d65051700000001426f62048302626f053e000000004d6f65068304626f626f053e000000004d6f6500", vec);
+
+  auto dl = crow::GenericDecoderListener();
+  auto pDec = crow::DecoderFactory::New(vec.data(), vec.size());
+  pDec->addPredicate(crow::Predicate::Equals(10, 62));
+  pDec->addPredicate(crow::Predicate::Equals("name", "bobo"));
+  auto numRows = pDec->decode(dl);
+  ASSERT_EQ(1, numRows);
+  ASSERT_EQ("62,0,Moe,bobo||", to_csv(dl._rows, dl._structData, pDec->getFields()));
+
+  delete pDec;
+}
+
+TEST_F(DecStructTest, framedStructRows)
+{
+  auto pEnc = crow::EncoderFactory::New();
+  auto &enc = *pEnc;
+  Person person = Person();
+  const SPFieldDef NAME = FieldDef::alloc(TSTRING, "name");
+
+  enc.startTable(TABLE_FLAG_FRAMED);
+  enc.struct_hdr(FieldDef::alloc(TINT32, 10));
+  enc.struct_hdr(FieldDef::alloc(TUINT8, 11));
+  enc.struct_hdr(FieldDef::alloc(TSTRING, 12), sizeof(person.name));
+
+  PERSON(person,"Bob", 23, true);
+  enc.put_struct(&person, sizeof(person));
+  enc.put(NAME, "bo");
+  enc.startRow();
+  PERSON(person,"Moe", 62, false);
+  enc.put_struct(&person, sizeof(person));
+  enc.startRow();
+
+  const uint8_t* result = enc.data();
+
+  auto dl = crow::GenericDecoderListener();
+  auto pDec = crow::DecoderFactory::New(result, enc.size());
+  ASSERT_EQ(2, pDec->decode(dl));
+  ASSERT_EQ("23,1,Bob,bo||62,0,Moe||", to_csv(dl._rows, dl._structData, pDec->getFields()));
+  delete pDec;
+
+  pDec = crow::DecoderFactory::New(result, enc.size());
+  ASSERT_EQ(2, pDec->skipRows(10));
+  delete pDec;
+  delete pEnc;
+}
+
+TEST_F(DecStructTest, streamChunks)
+{
+  auto vec = std::vector<uint8_t>();
+  HexStringToVec("1300020a1301090b1302010c0343030100046e616d65051700000001426f62048302626f053e000000004d6f65068304626f626f053e000000004d6f6500", vec);
+
+  for (size_t chunk = 1; chunk < 8; chunk++) {
+    auto dl = crow::GenericDecoderListener();
+    crow::StreamDecoder stream(dl);
+    for (size_t i = 0; i < vec.size(); i += chunk) {
+      ASSERT_EQ(0, stream.feed(vec.data() + i, std::min(chunk, vec.size() - i)));
+    }
+    ASSERT_EQ(3, dl._structData.size());
+    ASSERT_EQ(0, stream.finish());
+    ASSERT_EQ(3, stream.numRows());
+    std::string actual = to_csv(dl._rows, dl._structData, stream.decoder().getFields());
+    ASSERT_EQ("23,1,Bob,bo||62,0,Moe,bobo||62,0,Moe||", actual);
+  }
+}
+
+TEST_F(DecStructTest, structBlocks)
+{
+  auto pEnc = crow::EncoderFactory::New();
+  auto &enc = *pEnc;
+  Person person = Person();
+  const SPFieldDef NAME = FieldDef::alloc(TSTRING, "name");
+
+  enc.setBlockPolicy(crow::BlockPolicy(1));
+  enc.struct_hdr(FieldDef::alloc(TINT32, 10));
+  enc.struct_hdr(FieldDef::alloc(TUINT8, 11));
+  enc.struct_hdr(FieldDef::alloc(TSTRING, 12), sizeof(person.name));
+
+  PERSON(person,"Bob", 23, true);
+  enc.put_struct(&person, sizeof(person));
+  enc.put(NAME, "bo");
+  enc.startRow();
+  PERSON(person,"Moe", 62, false);
+  enc.put_struct(&person, sizeof(person));
+  enc.startRow();
+
+  const uint8_t* result = enc.data();
+  size_t len = enc.size();
+
+  auto dl = crow::GenericDecoderListener();
+  auto pDec = crow::DecoderFactory::New(result, len);
+  ASSERT_EQ(2, pDec->decode(dl));
+  ASSERT_EQ("23,1,Bob,bo||62,0,Moe||", to_csv(dl._rows, dl._structData, pDec->getFields()));
+  delete pDec;
+
+  // second block on its own
+
+  uint32_t blockLen;
+  memcpy(&blockLen, result + 1, sizeof(blockLen));
+  size_t offset = 1 + BLOCK_LEN_SIZE + blockLen;
+  ASSERT_EQ(TBLOCK, result[offset]);
+
+  dl = crow::GenericDecoderListener();
+  pDec = crow::DecoderFactory::New(result + offset, len - offset);
+  ASSERT_EQ(1, pDec->decode(dl));
+  ASSERT_EQ("62,0,Moe||", to_csv(dl._rows, dl._structData, pDec->getFields()));
+  delete pDec;
+  delete pEnc;
+}
+
+// put_columns can't supply struct data, so struct tables are refused
+// and rows put around it still decode
+
+TEST_F(DecStructTest, putColumnsOnStructTable)
+{
+  auto pEnc = crow::EncoderFactory::New();
+  auto &enc = *pEnc;
+  Person person = Person();
+  const SPFieldDef NAME = FieldDef::alloc(TSTRING, "name");
+
+  enc.struct_hdr(FieldDef::alloc(TINT32, 10));
+  enc.struct_hdr(FieldDef::alloc(TUINT8, 11));
+  enc.struct_hdr(FieldDef::alloc(TSTRING, 12), sizeof(person.name));
+  crow::FieldHandle hName = enc.addField(NAME);
+
+  PERSON(person,"Bob", 23, true);
+  enc.put_struct(&person, sizeof(person));
+  enc.put(NAME, "bo");
+
+  std::vector<std::string> names({"a", "bb"});
+  ASSERT_EQ(-1, enc.put_columns({hName}, {names.data()}, 2));
+
+  enc.startRow();
+  PERSON(person,"Moe", 62, false);
+  enc.put_struct(&person, sizeof(person));
+  enc.put(NAME, "mo");
+  enc.startRow();
+
+  auto dl = crow::GenericDecoderListener();
+  auto pDec = crow::DecoderFactory::New(enc.data(), enc.size());
+  ASSERT_EQ(2, pDec->decode(dl));
+  ASSERT_EQ(0, pDec->getErrCode());
+  ASSERT_EQ("23,1,Bob,bo||62,0,Moe,mo||", to_csv(dl._rows, dl._structData, pDec->getFields()));
+  delete pDec;
+  delete pEnc;
+}
@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 #include "../include/crow.hpp"
 #include "../include/crow/crow_test_decoder.hpp"
+#include "../include/crow/crow_columnar_decoder.hpp"
+#include "../include/crow/crow_parallel_decoder.hpp"
 #include "test_defs.hpp"
 
 
@@ -405,6 +407,308 @@ TEST_F(DecTest, decorators) {
   delete pDec;
 }
 
+class StaticSumListener : public crow::StaticDecoderListener {
+public:
+  using crow::StaticDecoderListener::onField;
+  StaticSumListener() : sum(0), rows(0) {}
+  void onField(const crow::SPCFieldInfo&, int32_t value, uint8_t flags) { sum += value; }
+  void onField(const crow::SPCFieldInfo&, const crow::ByteView &value, uint8_t flags) { names.append(value.chars(), value.size()); }
+  void onRowStart() { rows++; }
+  int64_t sum;
+  size_t rows;
+  std::string names;
+};
+
+TEST_F(DecTest, staticListener) {
+  auto vec = std::vector<uint8_t>();
+  HexStringToVec("43000100046e616d6543010200036167654302090006616374697665058003626f62812e82010580056a65727279817482000580056c696e646181428201", vec);
+
+  StaticSumListener listener;
+  crow::DecoderImpl dec(vec.data(), vec.size());
+  ASSERT_EQ(3, dec.decode(listener));
+
+  ASSERT_EQ(23 + 58 + 33, listener.sum);
+  ASSERT_EQ(3, listener.rows);
+  ASSERT_EQ("bobjerrylinda", listener.names);
+}
+
+class ColumnListener : public crow::FieldDecoderListener {
+public:
+  void onField(const crow::FieldInfo &field, int32_t value, uint8_t flags) override {
+    cells.push_back(std::to_string(field.index) + ":" + std::to_string(value));
+  }
+  void onField(const crow::FieldInfo &field, uint8_t value, uint8_t flags) override {
+    cells.push_back(std::to_string(field.index) + ":" + std::to_string(value));
+  }
+  void onField(const crow::FieldInfo &field, const std::string &value, uint8_t flags) override {
+    cells.push_back(std::to_string(field.index) + ":" + value);
+  }
+  std::vector<std::string> cells;
+};
+
+TEST_F(DecTest, fieldInfoListener) {
+  auto vec = std::vector<uint8_t>();
+  HexStringToVec("43000100046e616d6543010200036167654302090006616374697665058003626f62812e82010580056a65727279817482000580056c696e646181428201", vec);
+
+  ColumnListener listener;
+  auto pDec = crow::DecoderFactory::New(vec.data(), vec.size());
+  pDec->decode(listener);
+
+  std::string actual;
+  for (auto &cell : listener.cells) { actual += cell + ","; }
+  ASSERT_EQ("0:bob,1:23,2:1,0:jerry,1:58,2:0,0:linda,1:33,2:1,", actual);
+
+  delete pDec;
+}
+
+class ViewListener : public crow::DecoderListener {
+public:
+  ViewListener(const uint8_t *start, const uint8_t *end) : start(start), end(end), last(nullptr, 0), views(0), inBuffer(0) {}
+  void onField(crow::SPCFieldInfo field, const crow::ByteView &value, uint8_t flags) override {
+    views++;
+    if (value.data() >= start && value.data() + value.size() <= end) { inBuffer++; }
+    last = value;
+  }
+  const uint8_t *start, *end;
+  crow::ByteView last;
+  int views, inBuffer;
+};
+
+// string and bytes values point into the encoded buffer
+TEST_F(DecTest, zeroCopyViews) {
+  auto vec = std::vector<uint8_t>();
+  HexStringToVec("03000c020580040badcafe0580040badcafe", vec);
+
+  ViewListener listener(vec.data(), vec.data() + vec.size());
+  auto pDec = crow::DecoderFactory::New(vec.data(), vec.size());
+  pDec->decode(listener);
+
+  ASSERT_EQ(2, listener.views);
+  ASSERT_EQ(2, listener.inBuffer);
+  ASSERT_TRUE(listener.last == crow::ByteView(vec.data() + 7, 4));
+
+  delete pDec;
+}
+
+// sparse rows, including 16 bit types
+TEST_F(DecTest, columnarSparse) {
+  static const SPFieldDef I16 = FieldDef::alloc(TINT16, 1);
+  static const SPFieldDef U16 = FieldDef::alloc(TUINT16, 2);
+  static const SPFieldDef F64 = FieldDef::alloc(TFLOAT64, 3);
+
+  auto pEnc = crow::EncoderFactory::New();
+  auto &enc = *pEnc;
+  enc.put(I16, (int16_t)-300);
+  enc.put(F64, 1.5);
+  enc.startRow();
+  enc.put(U16, (uint16_t)65000);
+  enc.startRow();
+  enc.put(I16, (int16_t)7);
+  enc.put(U16, (uint16_t)3);
+  enc.startRow();
+
+  const uint8_t *result = enc.data();
+  crow::ColumnarDecoderListener cols;
+  crow::DecoderImpl dec(result, enc.size());
+  dec.decode(cols);
+
+  ASSERT_EQ(3, cols.numRows());
+  ASSERT_EQ(std::vector<int32_t>({-300, 0, 7}), cols.column(0)->i32);
+  ASSERT_FALSE(cols.column(0)->isValid(1));
+  ASSERT_EQ(std::vector<uint32_t>({0, 65000, 3}), cols.column(2)->u32);
+  ASSERT_FALSE(cols.column(2)->isValid(0));
+  ASSERT_EQ(std::vector<double>({1.5, 0, 0}), cols.column(1)->f64);
+  ASSERT_TRUE(cols.column(1)->isValid(0));
+  ASSERT_FALSE(cols.column(1)->isValid(2));
+
+  delete pEnc;
+}
+
+// blocks of one table append to the same columns, a table with other
+// fields replaces them
+
+TEST_F(DecTest, columnarBlocks) {
+  static const SPFieldDef NAME = FieldDef::alloc(TSTRING, "name");
+  static const SPFieldDef AGE = FieldDef::alloc(TINT32, "age");
+  static const SPFieldDef X = FieldDef::alloc(TFLOAT64, "x");
+
+  auto pEnc = crow::EncoderFactory::New();
+  pEnc->setBlockPolicy(crow::BlockPolicy(10));
+  for (int i = 0; i < 100; i++) {
+    pEnc->put(NAME, "n" + std::to_string(i));
+    if (i & 1) { pEnc->put(AGE, i); }
+    pEnc->startRow();
+  }
+
+  const uint8_t *result = pEnc->data();
+  crow::ColumnarDecoderListener cols;
+  crow::DecoderImpl dec(result, pEnc->size());
+  ASSERT_EQ(100, dec.decode(cols));
+  ASSERT_EQ(100, cols.numRows());
+  ASSERT_EQ(100, cols.column(0)->numRows);
+  ASSERT_EQ("n57", cols.column(0)->str(57).str());
+  ASSERT_EQ(100, cols.column(1)->numRows);
+  ASSERT_EQ(57, cols.column(1)->i32[57]);
+  ASSERT_FALSE(cols.column(1)->isValid(58));
+
+  pEnc->clear();
+  pEnc->put(NAME, "a");
+  pEnc->put(AGE, 1);
+  pEnc->startRow();
+  pEnc->put(NAME, "b");
+  pEnc->startRow();
+  pEnc->startTable();
+  pEnc->put(NAME, "c");
+  pEnc->put(X, 1.5);
+  pEnc->startRow();
+
+  result = pEnc->data();
+  crow::ColumnarDecoderListener other;
+  crow::DecoderImpl dec2(result, pEnc->size());
+  dec2.decode(other);
+  ASSERT_EQ(1, other.numRows());
+  ASSERT_EQ(1, other.column(0)->numRows);
+  ASSERT_EQ("c", other.column(0)->str(0).str());
+  ASSERT_EQ(TFLOAT64, other.column(1)->field->typeId);
+  ASSERT_EQ(std::vector<double>({1.5}), other.column(1)->f64);
+  ASSERT_TRUE(other.column(1)->isValid(0));
+
+  delete pEnc;
+}
+
+TEST_F(DecTest, projection) {
+  auto vec = std::vector<uint8_t>();
+  HexStringToVec("43000100046e616d6543010200036167654302090006616374697665058003626f62812e82010580056a65727279817482000580056c696e646181428201", vec);
+
+  auto dl = crow::GenericDecoderListener();
+  auto pDec = crow::DecoderFactory::New(vec.data(), vec.size());
+  pDec->setProjection(std::vector<std::string>({"active", "name"}));
+  pDec->decode(dl);
+
+  ASSERT_EQ("bob,1||jerry,0||linda,1||", to_csv(dl._rows));
+  ASSERT_EQ(3, pDec->getFields().size());
+
+  delete pDec;
+}
+
+TEST_F(DecTest, predicates) {
+  auto vec = std::vector<uint8_t>();
+  HexStringToVec("43000100046e616d6543010200036167654302090006616374697665058003626f62812e82010580056a65727279817482000580056c696e646181428201", vec);
+
+  auto dl = crow::GenericDecoderListener();
+  auto pDec = crow::DecoderFactory::New(vec.data(), vec.size());
+  ASSERT_EQ(0, pDec->addPredicate(crow::Predicate::Range("age", 30, 60)));
+  pDec->decode(dl);
+  ASSERT_EQ("jerry,58,0||linda,33,1||", to_csv(dl._rows));
+  delete pDec;
+
+  dl = crow::GenericDecoderListener();
+  pDec = crow::DecoderFactory::New(vec.data(), vec.size());
+  pDec->addPredicate(crow::Predicate::InSet("name", {DynVal("bob"), DynVal("linda")}));
+  pDec->addPredicate(crow::Predicate::Equals("active", 1));
+  pDec->decode(dl);
+  ASSERT_EQ("bob,23,1||linda,33,1||", to_csv(dl._rows));
+  delete pDec;
+
+  // unknown field matches no rows
+
+  dl = crow::GenericDecoderListener();
+  pDec = crow::DecoderFactory::New(vec.data(), vec.size());
+  pDec->addPredicate(crow::Predicate::Equals(77, 1));
+  pDec->decode(dl);
+  ASSERT_EQ(0, dl._rows.size());
+
+  crow::Predicate bad = crow::Predicate::Range("age", 1, 2);
+  bad.values.pop_back();
+  ASSERT_EQ(-1, pDec->addPredicate(bad));
+  delete pDec;
+}
+
+TEST_F(DecTest, framedRows) {
+  static const SPFieldDef NAME = FieldDef::alloc(TSTRING, "name");
+  static const SPFieldDef AGE = FieldDef::alloc(TINT32, "age");
+
+  auto pEnc = crow::EncoderFactory::New();
+  auto &enc = *pEnc;
+  enc.startTable(TABLE_FLAG_FRAMED);
+  std::string longName(200, 'x');
+  enc.put(NAME, "bob");
+  enc.put(AGE, 23);
+  enc.startRow();
+  enc.put(NAME, longName);
+  enc.startRow();
+  enc.put(AGE, 33);
+  enc.startRow();
+  enc.put(NAME, "end");
+
+  const uint8_t* result = enc.data();
+  std::string hex;
+  BytesToHexString(result, 5, hex);
+  ASSERT_EQ("2243000100", hex);
+
+  // row lengths: 1 and 2 byte varints
+
+  size_t hdrLen = 1 + 9 + 8;
+  hex.clear();
+  BytesToHexString(result + hdrLen, 3, hex);
+  ASSERT_EQ("050780", hex);
+  hex.clear();
+  BytesToHexString(result + hdrLen + 9, 4, hex);
+  ASSERT_EQ("05cb0180", hex);
+
+  auto dl = crow::GenericDecoderListener();
+  auto pDec = crow::DecoderFactory::New(result, enc.size());
+  pDec->decode(dl);
+  ASSERT_EQ("bob,23||" + longName + "||33||end||", to_csv(dl._rows));
+  delete pDec;
+
+  // skip rows, then decode the rest
+
+  dl = crow::GenericDecoderListener();
+  pDec = crow::DecoderFactory::New(result, enc.size());
+  ASSERT_EQ(2, pDec->skipRows(2));
+  pDec->decode(dl);
+  ASSERT_EQ("33||end||", to_csv(dl._rows));
+  delete pDec;
+
+  pDec = crow::DecoderFactory::New(result, enc.size());
+  ASSERT_EQ(4, pDec->skipRows(100));
+  ASSERT_EQ(0, pDec->getErrCode());
+  delete pDec;
+
+  // truncated inside the long row
+
+  dl = crow::GenericDecoderListener();
+  pDec = crow::DecoderFactory::New(result, hdrLen + 9 + 50);
+  pDec->decode(dl);
+  ASSERT_EQ(ENOSPC, pDec->getErrCode());
+  ASSERT_EQ("bob,23||", to_csv(dl._rows));
+  delete pDec;
+
+  pDec = crow::DecoderFactory::New(result, hdrLen + 9 + 50);
+  ASSERT_EQ(1, pDec->skipRows(100));
+  ASSERT_EQ(ENOSPC, pDec->getErrCode());
+  delete pDec;
+
+  // put_columns writes the same framing
+
+  auto pEnc2 = crow::EncoderFactory::New();
+  pEnc2->startTable(TABLE_FLAG_FRAMED);
+  crow::FieldHandle hName = pEnc2->addField(NAME);
+  std::vector<std::string> names({"bob", longName});
+  pEnc2->put_columns({hName}, {names.data()}, 2);
+  const uint8_t* result2 = pEnc2->data();
+
+  dl = crow::GenericDecoderListener();
+  pDec = crow::DecoderFactory::New(result2, pEnc2->size());
+  pDec->decode(dl);
+  ASSERT_EQ("bob||" + longName + "||", to_csv(dl._rows));
+  delete pDec;
+
+  delete pEnc;
+  delete pEnc2;
+}
+
 uint8_t hexDigitValue(char c)
 {
   if (c >= 'a') {
@@ -422,3 +726,350 @@ void HexStringToVec(const std::string str, Bytes &dest)
     dest.push_back(val);
   }
 }
+
+TEST_F(DecTest, streamChunks) {
+  static const SPFieldDef NAME = FieldDef::alloc(TSTRING, "name");
+  static const SPFieldDef AGE = FieldDef::alloc(TINT32, "age");
+
+  for (uint8_t tableFlags : { (uint8_t)0, TABLE_FLAG_FRAMED }) {
+    auto pEnc = crow::EncoderFactory::New();
+    auto &enc = *pEnc;
+    enc.startTable(tableFlags);
+    enc.put(NAME, "bob");
+    enc.put(AGE, 23);
+    enc.startRow();
+    enc.put(NAME, std::string(200, 'x'));
+    enc.startRow();
+    enc.put(AGE, 33);
+    const uint8_t* result = enc.data();
+    size_t len = enc.size();
+
+    auto expected = crow::GenericDecoderListener();
+    auto pDec = crow::DecoderFactory::New(result, len);
+    pDec->decode(expected);
+    delete pDec;
+
+    for (size_t chunk = 1; chunk < 8; chunk++) {
+      auto dl = crow::GenericDecoderListener();
+      crow::StreamDecoder stream(dl);
+      for (size_t i = 0; i < len; i += chunk) {
+        ASSERT_EQ(0, stream.feed(result + i, std::min(chunk, len - i)));
+      }
+      ASSERT_EQ(0, stream.finish());
+      ASSERT_EQ(0, stream.pending());
+      ASSERT_EQ(3, stream.numRows());
+      ASSERT_EQ(to_csv(expected._rows), to_csv(dl._rows));
+    }
+
+    // framed rows are delivered without waiting for the next tag
+
+    auto dl = crow::GenericDecoderListener();
+    crow::StreamDecoder stream(dl);
+    ASSERT_EQ(0, stream.feed(result, len));
+    ASSERT_EQ((tableFlags ? 3 : 2), dl._rows.size());
+
+    // stream cut inside a row
+
+    dl = crow::GenericDecoderListener();
+    crow::StreamDecoder cut(dl);
+    ASSERT_EQ(0, cut.feed(result, len - 1));
+    ASSERT_EQ(ENOSPC, cut.finish());
+    delete pEnc;
+  }
+
+  // incomplete row larger than limit
+
+  auto dl = crow::GenericDecoderListener();
+  crow::StreamDecoder small(dl, 16);
+  auto pEnc = crow::EncoderFactory::New();
+  pEnc->put(NAME, std::string(100, 'y'));
+  const uint8_t* p = pEnc->data();
+  ASSERT_EQ(EMSGSIZE, small.feed(p, pEnc->size() - 1));
+  delete pEnc;
+}
+
+TEST_F(DecTest, decodeFromFile) {
+  static const SPFieldDef NAME = FieldDef::alloc(TSTRING, "name");
+  static const SPFieldDef AGE = FieldDef::alloc(TINT32, "age");
+
+  auto pEnc = crow::EncoderFactory::New();
+  for (int i = 0; i < 5000; i++) {
+    pEnc->put(NAME, "name" + std::to_string(i));
+    pEnc->put(AGE, i);
+    pEnc->startRow();
+  }
+  const uint8_t* result = pEnc->data();
+  size_t len = pEnc->size();
+
+  char path[] = "/tmp/crowtestXXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_TRUE(fd >= 0);
+  ASSERT_EQ((ssize_t)len, write(fd, result, len));
+  close(fd);
+
+  auto expected = crow::GenericDecoderListener();
+  auto pDec = crow::DecoderFactory::New(result, len);
+  pDec->decode(expected);
+  delete pDec;
+
+  // window of one page, so pages are advised and released while decoding
+
+  auto dl = crow::GenericDecoderListener();
+  pDec = crow::DecoderFactory::NewFromFile(path, 1);
+  ASSERT_TRUE(pDec != nullptr);
+  ASSERT_EQ(5000, pDec->decode(dl));
+  ASSERT_EQ(to_csv(expected._rows), to_csv(dl._rows));
+  delete pDec;
+
+  pDec = crow::DecoderFactory::NewFromFile(path);
+  ASSERT_EQ(4000, pDec->skipRows(4000));
+  dl = crow::GenericDecoderListener();
+  ASSERT_EQ(1000, pDec->decode(dl));
+  delete pDec;
+
+  unlink(path);
+  ASSERT_TRUE(crow::DecoderFactory::NewFromFile(path) == nullptr);
+  ASSERT_EQ(ENOENT, errno);
+  delete pEnc;
+}
+
+TEST_F(DecTest, blocks) {
+  static const SPFieldDef NAME = FieldDef::alloc(TSTRING, "name");
+  static const SPFieldDef AGE = FieldDef::alloc(TINT32, "age");
+
+  auto fill = [](crow::Encoder &enc) {
+    for (int i = 0; i < 5; i++) {
+      enc.put(NAME, "name" + std::to_string(i));
+      if (i & 1) { enc.put(AGE, i); }
+      enc.startRow();
+    }
+  };
+
+  auto pPlain = crow::EncoderFactory::New();
+  fill(*pPlain);
+  auto expected = crow::GenericDecoderListener();
+  auto pDec = crow::DecoderFactory::New(pPlain->data(), pPlain->size());
+  pDec->decode(expected);
+  delete pDec;
+
+  auto pEnc = crow::EncoderFactory::New();
+  pEnc->setBlockPolicy(crow::BlockPolicy(2));
+  fill(*pEnc);
+  const uint8_t* result = pEnc->data();
+  size_t len = pEnc->size();
+  ASSERT_EQ(TBLOCK, result[0]);
+
+  auto dl = crow::GenericDecoderListener();
+  pDec = crow::DecoderFactory::New(result, len);
+  ASSERT_EQ(5, pDec->decode(dl));
+  ASSERT_EQ(to_csv(expected._rows), to_csv(dl._rows));
+  delete pDec;
+
+  // each block decodes on its own
+
+  std::vector<std::string> blockRows;
+  size_t offset = 0;
+  while (offset < len) {
+    ASSERT_EQ(TBLOCK, result[offset]);
+    uint32_t blockLen;
+    memcpy(&blockLen, result + offset + 1, sizeof(blockLen));
+    dl = crow::GenericDecoderListener();
+    pDec = crow::DecoderFactory::New(result + offset, 1 + BLOCK_LEN_SIZE + blockLen);
+    pDec->decode(dl);
+    blockRows.push_back(to_csv(dl._rows));
+    delete pDec;
+    offset += 1 + BLOCK_LEN_SIZE + blockLen;
+  }
+  ASSERT_EQ(len, offset);
+  ASSERT_EQ(3, blockRows.size());
+  ASSERT_EQ("name4||", blockRows[2]);
+
+  // endRow writes complete blocks only
+
+  crow::MemorySink sink;
+  pEnc->clear();
+  for (int i = 0; i < 5; i++) {
+    pEnc->put(NAME, "name" + std::to_string(i));
+    if (i & 1) { pEnc->put(AGE, i); }
+    pEnc->endRow(sink);
+    if (i == 0) { ASSERT_EQ(0, sink.size()); }
+  }
+  ASSERT_TRUE(sink.size() > 0);
+  ASSERT_EQ(TBLOCK, sink.data()[0]);
+  pEnc->sync(sink);
+
+  dl = crow::GenericDecoderListener();
+  pDec = crow::DecoderFactory::New(sink.data(), sink.size());
+  ASSERT_EQ(5, pDec->decode(dl));
+  ASSERT_EQ(to_csv(expected._rows), to_csv(dl._rows));
+  delete pDec;
+
+  // truncated block
+
+  pDec = crow::DecoderFactory::New(result, 20);
+  dl = crow::GenericDecoderListener();
+  pDec->decode(dl);
+  ASSERT_EQ(0, dl._rows.size());
+  ASSERT_EQ(ENOSPC, pDec->getErrCode());
+  delete pDec;
+
+  pDec = crow::DecoderFactory::New(result, 3);
+  dl = crow::GenericDecoderListener();
+  pDec->decode(dl);
+  ASSERT_EQ(ENOSPC, pDec->getErrCode());
+  delete pDec;
+
+  delete pEnc;
+  delete pPlain;
+}
+
+TEST_F(DecTest, streamBlocks) {
+  static const SPFieldDef NAME = FieldDef::alloc(TSTRING, "name");
+  static const SPFieldDef AGE = FieldDef::alloc(TINT32, "age");
+
+  for (uint8_t tableFlags : { (uint8_t)0, TABLE_FLAG_FRAMED }) {
+    auto pEnc = crow::EncoderFactory::New();
+    pEnc->setBlockPolicy(crow::BlockPolicy(8));
+    pEnc->startTable(tableFlags);
+    for (int i = 0; i < 35; i++) {
+      pEnc->put(NAME, "name" + std::to_string(i));
+      if (i % 3) { pEnc->put(AGE, i); }
+      pEnc->startRow();
+    }
+    const uint8_t* result = pEnc->data();
+    size_t len = pEnc->size();
+    ASSERT_EQ(TBLOCK, result[0]);
+
+    auto expected = crow::GenericDecoderListener();
+    auto pDec = crow::DecoderFactory::New(result, len);
+    ASSERT_EQ(35, pDec->decode(expected));
+    ASSERT_EQ(0, pDec->getErrCode());
+    delete pDec;
+
+    for (size_t chunk : { 1, 2, 3, 5, 7, 50, 4096 }) {
+      auto dl = crow::GenericDecoderListener();
+      crow::StreamDecoder stream(dl);
+      for (size_t i = 0; i < len; i += chunk) {
+        ASSERT_EQ(0, stream.feed(result + i, std::min(chunk, len - i)));
+      }
+      ASSERT_EQ(0, stream.finish());
+      ASSERT_EQ(0, stream.pending());
+      ASSERT_EQ(35, stream.numRows());
+      ASSERT_EQ(to_csv(expected._rows), to_csv(dl._rows));
+    }
+
+    // stream cut inside a block
+
+    auto dl = crow::GenericDecoderListener();
+    crow::StreamDecoder cut(dl);
+    ASSERT_EQ(0, cut.feed(result, len - 1));
+    ASSERT_EQ(ENOSPC, cut.finish());
+    delete pEnc;
+  }
+}
+
+TEST_F(DecTest, parallelBlocks) {
+  static const SPFieldDef NAME = FieldDef::alloc(TSTRING, "name");
+  static const SPFieldDef AGE = FieldDef::alloc(TINT32, "age");
+
+  auto pEnc = crow::EncoderFactory::New();
+  pEnc->setBlockPolicy(crow::BlockPolicy(37));
+  int64_t sum = 0;
+  for (int i = 0; i < 1000; i++) {
+    pEnc->put(NAME, "n" + std::to_string(i));
+    pEnc->put(AGE, i);
+    pEnc->startRow();
+    sum += i;
+  }
+  const uint8_t* result = pEnc->data();
+  size_t len = pEnc->size();
+
+  crow::ParallelDecoder pdec(result, len);
+  ASSERT_EQ(0, pdec.getErrCode());
+  ASSERT_EQ(28, pdec.numBlocks());
+
+  // per-thread listeners
+
+  std::vector<StaticSumListener> listeners(4);
+  ASSERT_EQ(1000, pdec.decode(listeners));
+  int64_t total = 0;
+  size_t rows = 0;
+  for (auto &l : listeners) {
+    total += l.sum;
+    rows += l.rows;
+  }
+  ASSERT_EQ(sum, total);
+  ASSERT_EQ(1000, rows);
+
+  // columnar listener per thread keeps the rows of all its blocks
+
+  std::vector<crow::ColumnarDecoderListener> perThread(4);
+  ASSERT_EQ(1000, pdec.decode(perThread));
+  total = 0;
+  rows = 0;
+  for (auto &cols : perThread) {
+    rows += cols.numRows();
+    if (cols.numRows() == 0) { continue; }
+    ASSERT_EQ(cols.numRows(), cols.column(1)->numRows);
+    for (int32_t age : cols.column(1)->i32) { total += age; }
+  }
+  ASSERT_EQ(sum, total);
+  ASSERT_EQ(1000, rows);
+
+  // ordered merge
+
+  auto expected = crow::GenericDecoderListener();
+  auto pDec = crow::DecoderFactory::New(result, len);
+  pDec->decode(expected);
+  delete pDec;
+
+  std::string merged;
+  size_t nextBlock = 0;
+  ASSERT_EQ(1000, (pdec.decodeOrdered<crow::GenericDecoderListener>(
+    [&](size_t block, crow::GenericDecoderListener &dl) {
+      ASSERT_EQ(nextBlock++, block);
+      merged += to_csv(dl._rows);
+    }, 3)));
+  ASSERT_EQ(to_csv(expected._rows), merged);
+
+  // projection applied to each block
+
+  pdec.setDecoderSetup([](crow::Decoder &dec) { dec.setProjection(std::vector<std::string>({"age"})); });
+  std::vector<StaticSumListener> ages(2);
+  pdec.decode(ages);
+  ASSERT_EQ(sum, ages[0].sum + ages[1].sum);
+  ASSERT_EQ("", ages[0].names + ages[1].names);
+
+  // deliver throws
+
+  size_t numDelivered = 0;
+  ASSERT_THROW((pdec.decodeOrdered<crow::GenericDecoderListener>(
+    [&](size_t block, crow::GenericDecoderListener &dl) {
+      if (++numDelivered == 2) { throw std::runtime_error("stop"); }
+    }, 3)), std::runtime_error);
+  ASSERT_EQ(2, numDelivered);
+
+  // truncated
+
+  crow::ParallelDecoder cut(result, len - 1);
+  ASSERT_EQ(EINVAL, cut.getErrCode());
+
+  // block length is valid, contents are not
+
+  Bytes corrupt(result, result + len);
+  size_t second = pdec.blocks()[1].offset;
+  corrupt[second + 1 + BLOCK_LEN_SIZE] = 0x0F;    // unknown tag in place of TTABLE
+
+  pDec = crow::DecoderFactory::New(corrupt.data(), corrupt.size());
+  pDec->decode(expected);
+  int seqErr = pDec->getErrCode();
+  delete pDec;
+  ASSERT_NE(0, seqErr);
+
+  crow::ParallelDecoder bad(corrupt.data(), corrupt.size());
+  ASSERT_EQ(0, bad.getErrCode());
+  std::vector<StaticSumListener> badListeners(4);
+  bad.decode(badListeners);
+  ASSERT_EQ(seqErr, bad.getErrCode());
+  delete pEnc;
+}
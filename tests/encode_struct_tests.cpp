@@ -9,6 +9,69 @@ class EncStructTest : public ::testing::Test {
   }
 };
 
+TEST_F(EncStructTest, structAndVariable)
+{
+  auto pEnc = crow::EncoderFactory::New();
+  auto &enc = *pEnc;
+
+  std::string s = "";
+  Person person = Person();
+
+  const SPFieldDef NAME = FieldDef::alloc(TSTRING, "name");
+
+  enc.struct_hdr(FieldDef::alloc(TINT32, 10));
+  enc.struct_hdr(FieldDef::alloc(TUINT8, 11));
+  enc.struct_hdr(FieldDef::alloc(TSTRING, 12), sizeof(person.name));
+
+  s += "1300020a";
+  s += "1301090b";
+  s += "1302010c03";
+
+  PERSON(person,"Bob", 23, true);
+  enc.put_struct(&person, sizeof(person));
+  enc.put(NAME, "bo");         s += "43030100046e616d65";  // field def
+
+  s += "05";
+  s += "17000000";
+  s += "01";
+  s += "426f62";
+  s += "04"; // length of variable field section
+  s += "8302626f";
+
+  PERSON(person,"Moe", 62, false);
+  enc.startRow();
+  enc.put_struct(&person, sizeof(person));
+  enc.put(NAME, "bobo");
+
+  s += "05";
+  s += "3e000000";
+  s += "00";
+  s += "4d6f65";
+  s += "06"; // length of variable field section
+  s += "8304626f626f";
+
+  // third row : no variable data
+  enc.startRow();
+  enc.put_struct(&person, sizeof(person));
+
+  s += "05";
+  s += "3e000000";
+  s += "00";
+  s += "4d6f65";
+  s += "00"; // length of variable field section
+
+  const uint8_t* result = enc.data();
+
+  std::string actual;
+  BytesToHexString(result, enc.size(), actual);
+
+  if (ENC_GTEST_LOG_ENABLED) printf(" %s\n", actual.c_str());
+
+  ASSERT_EQ(s, actual);
+
+  delete pEnc;
+}
+
 #ifdef NEVER
 TEST_F(EncStructTest, encodesStructAndVariable)
 {
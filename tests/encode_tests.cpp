@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 #include "../include/crow.hpp"
+#include "../include/crow/crow_row_encoder.hpp"
+#include "../include/crow/crow_row_queue.hpp"
 
 #include "test_defs.hpp"
 
@@ -448,6 +450,218 @@ TEST_F(EncTest, decorators) {
   delete pEnc;
 }
 
+// Typed puts should produce same encoding as DynVal puts
+TEST_F(EncTest, typedPuts)
+{
+  static const SPFieldDef S16 = FieldDef::alloc(TINT16, "s16");
+  static const SPFieldDef U64 = FieldDef::alloc(TUINT64, "u64");
+  static const SPFieldDef BYT = FieldDef::alloc(TBYTES, "byt");
+
+  auto pEnc = crow::EncoderFactory::New();
+  auto &enc = *pEnc;
+  auto pTyped = crow::EncoderFactory::New();
+  auto &typed = *pTyped;
+
+  std::string name = "jerry";
+  Bytes bytes = { 0x0b, 0xad, 0xca, 0xfe };
+
+  enc.put(fname, DynVal(name));
+  enc.put(fage, DynVal(58));
+  enc.put(factive, DynVal((uint8_t)1));
+  enc.put(S16, DynVal((int16_t)-300));
+  enc.put(U64, DynVal((uint64_t)0x123456789ULL));
+  enc.put(BYT, DynVal(bytes));
+  enc.startRow();
+  enc.put(fname, DynVal("linda"));
+  enc.put(fage, DynVal(33));
+
+  typed.put(fname, name);
+  typed.put(fage, (int32_t)58);
+  typed.put(factive, true);
+  typed.put(S16, (int16_t)-300);
+  typed.put(U64, (uint64_t)0x123456789ULL);
+  typed.put(BYT, bytes);
+  typed.startRow();
+  typed.put(fname, "lindaXX", 5);
+  typed.put(fage, (int64_t)33);   // converted to field type
+
+  enc.flush();
+  typed.flush();
+
+  std::string expected, actual;
+  BytesToHexString(enc.data(), enc.size(), expected);
+  BytesToHexString(typed.data(), typed.size(), actual);
+
+  ASSERT_EQ(expected, actual);
+
+  delete pEnc;
+  delete pTyped;
+}
+
+TEST_F(EncTest, fieldHandles)
+{
+  auto pEnc = crow::EncoderFactory::New();
+  auto &enc = *pEnc;
+
+  std::string s = "";
+
+  auto hName = enc.addField(fname);      s += "43000100046e616d65";
+  auto hAge = enc.addField(fage);        s += "4301020003616765";
+  auto hActive = enc.addField(factive);  s += "4302090006616374697665";
+
+  ASSERT_EQ(0, hName);
+  ASSERT_EQ(1, hAge);
+  ASSERT_EQ(2, hActive);
+  ASSERT_EQ(hAge, enc.addField(fage));   // already defined
+
+  s += "05";
+  enc.put(hName, "bob");       s += "8003626f62";
+  enc.put(hAge, 23);           s += "812e";
+  enc.put(hActive, true);      s += "8201";
+
+  enc.startRow();              s += "05";
+  enc.put(fname, "jerry");     s += "80056a65727279";   // mix with SPFieldDef puts
+  enc.put(hAge, DynVal(58));   s += "8174";
+
+  ASSERT_EQ(-1, enc.put(3, 1));   // not a valid handle
+  ASSERT_EQ(-1, enc.addField(SPFieldDef()));
+
+  const uint8_t* result = enc.data();
+
+  std::string actual;
+  BytesToHexString(result, enc.size(), actual);
+
+  ASSERT_EQ(s, actual);
+
+  delete pEnc;
+}
+
+// put_columns should produce same encoding as row at a time puts
+TEST_F(EncTest, putColumns)
+{
+  static const SPFieldDef I8 = FieldDef::alloc(TINT8, "i8");
+  static const SPFieldDef U16 = FieldDef::alloc(TUINT16, "u16");
+  static const SPFieldDef I64 = FieldDef::alloc(TINT64, "i64");
+
+  std::vector<std::string> names = { "bob", "jerry", "", "linda" };
+  std::vector<int32_t> ages = { 23, -58, 0, 2000000 };
+  std::vector<int8_t> i8s = { -1, 2, -3, 4 };
+  std::vector<uint16_t> ports = { 80, 443, 8080, 65535 };
+  std::vector<int64_t> i64s = { -(1LL << 40), 1, 0, 1LL << 62 };
+  std::vector<double> dbls = { 3000444888.325, 0, -1.5, 1e300 };
+  std::vector<float> flts = { 123.456f, 0, -1.5f, 1e30f };
+
+  auto pEnc = crow::EncoderFactory::New();
+  auto &enc = *pEnc;
+  auto pCols = crow::EncoderFactory::New();
+  auto &cols = *pCols;
+
+  for (size_t i=0; i < names.size(); i++) {
+    enc.put(fname, names[i]);
+    enc.put(fage, ages[i]);
+    enc.put(I8, i8s[i]);
+    enc.put(U16, ports[i]);
+    enc.put(I64, i64s[i]);
+    enc.put(D, dbls[i]);
+    enc.put(F, flts[i]);
+    enc.startRow();
+  }
+
+  std::vector<crow::FieldHandle> fields = {
+    cols.addField(fname), cols.addField(fage), cols.addField(I8), cols.addField(U16),
+    cols.addField(I64), cols.addField(D), cols.addField(F) };
+  std::vector<const void *> columns = {
+    names.data(), ages.data(), i8s.data(), ports.data(), i64s.data(), dbls.data(), flts.data() };
+
+  ASSERT_EQ(0, cols.put_columns(fields, columns, 2));
+  ASSERT_EQ(0, cols.put_columns(fields, { &names[2], &ages[2], &i8s[2], &ports[2], &i64s[2], &dbls[2], &flts[2] }, 2));
+  ASSERT_EQ(-1, cols.put_columns(fields, { names.data() }, 1));
+
+  enc.flush();
+  cols.flush();
+
+  std::string expected, actual;
+  BytesToHexString(enc.data(), enc.size(), expected);
+  BytesToHexString(cols.data(), cols.size(), actual);
+
+  ASSERT_EQ(expected, actual);
+
+  delete pEnc;
+  delete pCols;
+}
+
+// pooled encoders come back with schema reset
+TEST_F(EncTest, encoderPool)
+{
+  std::string expected = "43000100046e616d6543010200036167650580036a696d8114";
+
+  crow::Encoder *pFirst;
+  {
+    auto pEnc = crow::EncoderPool::AcquirePtr();
+    pFirst = pEnc.get();
+    pEnc->put(fname, "bob");
+    pEnc->put(fage, 23);
+    pEnc->startRow();
+    pEnc->put(fname, "bob");
+  }
+
+  auto pEnc = crow::EncoderPool::AcquirePtr();
+  ASSERT_EQ(pFirst, pEnc.get());
+  ASSERT_EQ(0, pEnc->size());
+
+  pEnc->put(fname, "jim");
+  pEnc->put(fage, 10);
+
+  const uint8_t* result = pEnc->data();
+
+  std::string actual;
+  BytesToHexString(result, pEnc->size(), actual);
+
+  ASSERT_EQ(expected, actual);
+}
+
+// compile-time row encoder matches output of EncoderImpl
+TEST_F(EncTest, rowEncoder)
+{
+  static const SPFieldDef fscore = FieldDef::alloc(TFLOAT64, "score");
+  static const SPFieldDef fid = FieldDef::alloc(TUINT64, 9);
+
+  auto pEnc = crow::EncoderFactory::New();
+  auto &enc = *pEnc;
+  crow::RowEncoder<crow::Field<TSTRING>, crow::Field<TINT32>, crow::Field<TFLOAT64>,
+                   crow::Field<TUINT64>> renc(fname, fage, fscore, fid);
+
+  const char *names[] = { "bob", "", "jennifer" };
+  int32_t ages[] = { 23, -5, 1 << 20 };
+  for (int i=0; i < 3; i++) {
+    enc.put(fname, names[i]);
+    enc.put(fage, ages[i]);
+    enc.put(fscore, i * 1.5);
+    enc.put(fid, (uint64_t)i << 40);
+    enc.startRow();
+
+    renc.putRow(names[i], ages[i], i * 1.5, (uint64_t)i << 40);
+  }
+
+  const uint8_t* result = enc.data();
+  std::string expected;
+  BytesToHexString(result, enc.size(), expected);
+
+  std::string actual;
+  BytesToHexString(renc.data(), renc.size(), actual);
+
+  ASSERT_EQ(expected, actual);
+
+  // headers are written again after clear
+
+  renc.clear();
+  renc.putRow(names[0], ages[0], 0.0, 0);
+  ASSERT_EQ(0, memcmp(result, renc.data(), 10));
+
+  ASSERT_THROW(crow::RowEncoder<crow::Field<TUINT8>> bad(fname), std::invalid_argument*);
+  delete pEnc;
+}
+
 static const char hexCharsLower[] = {
   '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
 };
@@ -481,3 +695,51 @@ void BytesToHexString(const std::string &bytes, std::string &dest)
 {
   BytesToHexString((const unsigned char *)bytes.data(), bytes.size(), dest);
 }
+
+TEST_F(EncTest, rowQueue)
+{
+  static const int NUM_THREADS = 4;
+  static const int NUM_ROWS = 5000;
+  static const SPFieldDef fshard = FieldDef::alloc(TINT32, "shard");
+
+  crow::MemorySink mem;
+  {
+    // small ring, so producers find it full
+    crow::RowQueue<crow::Field<TINT32>, crow::Field<TINT32>, crow::Field<TSTRING>> queue(mem, 8, 64, fshard, fage, fname);
+    ASSERT_EQ(8, queue.capacity());
+    ASSERT_EQ(EMSGSIZE, queue.tryPutRow(0, 0, std::string(100, 'x')));
+
+    std::vector<std::thread> threads;
+    for (int t=0; t < NUM_THREADS; t++) {
+      threads.push_back(std::thread([&queue, t]() {
+        for (int i=0; i < NUM_ROWS; i++) {
+          queue.putRow(t, i, "n" + std::to_string(i));
+        }
+      }));
+    }
+    for (auto &th : threads) { th.join(); }
+    queue.close();
+    ASSERT_EQ(0, queue.getErrCode());
+    ASSERT_EQ(EPIPE, queue.tryPutRow(0, 0, "late"));
+  }
+
+  auto dl = crow::GenericDecoderListener();
+  auto pDec = crow::DecoderFactory::New(mem.data(), mem.size());
+  ASSERT_EQ(NUM_THREADS * NUM_ROWS, pDec->decode(dl));
+
+  std::vector<int> next(NUM_THREADS, 0);
+  for (auto &row : dl._rows) {
+    int shard = -1, age = -1;
+    std::string name;
+    for (auto &it : row) {
+      if (it.first->name == "shard") { shard = it.second.as_i32(); }
+      if (it.first->name == "age") { age = it.second.as_i32(); }
+      if (it.first->name == "name") { name = it.second.as_s(); }
+    }
+    ASSERT_TRUE(shard >= 0 && shard < NUM_THREADS);
+    ASSERT_EQ(next[shard], age);
+    ASSERT_EQ("n" + std::to_string(next[shard]), name);
+    next[shard]++;
+  }
+  delete pDec;
+}
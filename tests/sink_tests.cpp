@@ -0,0 +1,330 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <thread>
+#include "../include/crow.hpp"
+#include "test_defs.hpp"
+
+class SinkTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+
+  }
+};
+
+static const SPFieldDef fname = FieldDef::alloc(TSTRING, "name");
+static const SPFieldDef fage = FieldDef::alloc(TINT32, "age");
+
+static void encodeRows(crow::Encoder &enc, int numRows, crow::Sink *sink)
+{
+  char tmp[32];
+  for (int i=0; i < numRows; i++) {
+    snprintf(tmp, sizeof(tmp), "name%d", i);
+    enc.put(fname, tmp);
+    enc.put(fage, i);
+    if (sink != nullptr) {
+      enc.endRow(*sink);
+    } else {
+      enc.startRow();
+    }
+  }
+}
+
+TEST_F(SinkTest, memorySinkMatchesData)
+{
+  auto pEnc = crow::EncoderFactory::New();
+  auto pExpected = crow::EncoderFactory::New();
+  crow::MemorySink sink;
+
+  encodeRows(*pEnc, 50, &sink);
+  encodeRows(*pExpected, 50, nullptr);
+  pExpected->flush();
+
+  ASSERT_EQ(0, pEnc->size());
+  ASSERT_EQ(pExpected->size(), sink.size());
+  ASSERT_EQ(0, memcmp(pExpected->data(), sink.data(), sink.size()));
+
+  delete pEnc;
+  delete pExpected;
+}
+
+TEST_F(SinkTest, structRowSegments)
+{
+  auto pEnc = crow::EncoderFactory::New();
+  auto &enc = *pEnc;
+  crow::MemorySink sink;
+
+  Person person = Person();
+
+  enc.struct_hdr(FieldDef::alloc(TINT32, 10));
+  enc.struct_hdr(FieldDef::alloc(TUINT8, 11));
+  enc.struct_hdr(FieldDef::alloc(TSTRING, 12), sizeof(person.name));
+
+  PERSON(person,"Bob", 23, true);
+  enc.put_struct(&person, sizeof(person));
+  enc.put(fname, "bo");
+  enc.endRow(sink);
+
+  PERSON(person,"Moe", 62, false);
+  enc.put_struct(&person, sizeof(person));
+  enc.put(fname, "bobo");
+  enc.endRow(sink);
+
+  std::string actual;
+  BytesToHexString(sink.data(), sink.size(), actual);
+
+  ASSERT_EQ("1300020a1301090b1302010c0343030100046e616d65051700000001426f62048302626f053e000000004d6f65068304626f626f", actual);
+
+  delete pEnc;
+}
+
+TEST_F(SinkTest, fdSinkNonBlockingPipe)
+{
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+
+  auto pExpected = crow::EncoderFactory::New();
+  encodeRows(*pExpected, 20000, nullptr);
+  pExpected->flush();
+  size_t expectedSize = pExpected->size();
+
+  // drain pipe on another thread, so writer sees EAGAIN and short writes
+  std::vector<uint8_t> received;
+  std::thread reader([&]() {
+    uint8_t buf[512];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+      received.insert(received.end(), buf, buf + n);
+    }
+  });
+
+  auto pEnc = crow::EncoderFactory::New();
+  encodeRows(*pEnc, 20000, nullptr);
+  pEnc->flushfd(fds[1]);
+  close(fds[1]);
+  reader.join();
+  close(fds[0]);
+
+  ASSERT_EQ(0, pEnc->getErrCode());
+  ASSERT_EQ(expectedSize, received.size());
+  ASSERT_EQ(0, memcmp(pExpected->data(), received.data(), expectedSize));
+
+  delete pEnc;
+  delete pExpected;
+}
+
+TEST_F(SinkTest, callbackSinkError)
+{
+  auto pEnc = crow::EncoderFactory::New();
+  size_t total = 0;
+  crow::CallbackSink sink([&](const uint8_t *data, size_t len) {
+    total += len;
+    return (total > 100 ? ENOSPC : 0);
+  });
+
+  encodeRows(*pEnc, 5, &sink);
+  ASSERT_EQ(0, pEnc->getErrCode());
+
+  encodeRows(*pEnc, 10, &sink);
+  ASSERT_EQ(ENOSPC, pEnc->getErrCode());
+
+  delete pEnc;
+}
+
+TEST_F(SinkTest, flushPolicyRows)
+{
+  auto pEnc = crow::EncoderFactory::New();
+  auto pExpected = crow::EncoderFactory::New();
+  crow::MemorySink mem;
+  int numWrites = 0;
+  crow::CallbackSink sink([&](const uint8_t *data, size_t len) {
+    numWrites++;
+    struct iovec iov = { (void*)data, len };
+    return mem.write(&iov, 1);
+  });
+
+  pEnc->setFlushPolicy(crow::FlushPolicy(10));
+  encodeRows(*pEnc, 25, &sink);
+  ASSERT_EQ(2, numWrites);
+  ASSERT_TRUE(pEnc->size() > 0);
+
+  pEnc->sync(sink);
+  ASSERT_EQ(3, numWrites);
+  ASSERT_EQ(0, pEnc->size());
+
+  encodeRows(*pExpected, 25, nullptr);
+  pExpected->flush();
+  ASSERT_EQ(pExpected->size(), mem.size());
+  ASSERT_EQ(0, memcmp(pExpected->data(), mem.data(), mem.size()));
+
+  delete pEnc;
+  delete pExpected;
+}
+
+TEST_F(SinkTest, flushPolicyBytesAndLatency)
+{
+  auto pEnc = crow::EncoderFactory::New();
+  int numWrites = 0;
+  crow::CallbackSink sink([&](const uint8_t *data, size_t len) {
+    numWrites++;
+    return 0;
+  });
+
+  pEnc->setFlushPolicy(crow::FlushPolicy(0, 1000));
+  encodeRows(*pEnc, 100, &sink);
+  ASSERT_TRUE(numWrites > 0);
+  ASSERT_TRUE(numWrites < 10);
+
+  pEnc->sync(sink);
+  numWrites = 0;
+  pEnc->setFlushPolicy(crow::FlushPolicy(0, 0, 5));
+  encodeRows(*pEnc, 3, &sink);
+  ASSERT_EQ(0, numWrites);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  encodeRows(*pEnc, 1, &sink);
+  ASSERT_EQ(1, numWrites);
+  ASSERT_EQ(0, pEnc->size());
+
+  delete pEnc;
+}
+
+TEST_F(SinkTest, asyncSink)
+{
+  auto pEnc = crow::EncoderFactory::New();
+  auto pExpected = crow::EncoderFactory::New();
+  crow::MemorySink mem;
+  int numWrites = 0;
+  crow::CallbackSink slow([&](const uint8_t *data, size_t len) {
+    numWrites++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    struct iovec iov = { (void*)data, len };
+    return mem.write(&iov, 1);
+  });
+
+  {
+    crow::AsyncSink sink(slow, 2);
+
+    // each row is due, but encoder keeps batching while sink is backed up
+    encodeRows(*pEnc, 2000, &sink);
+    pEnc->sync(sink);
+    sink.drain();
+
+    ASSERT_EQ(0, sink.queued());
+    ASSERT_EQ(0, sink.getErrCode());
+  }
+  ASSERT_TRUE(numWrites < 2000);
+
+  encodeRows(*pExpected, 2000, nullptr);
+  pExpected->flush();
+  ASSERT_EQ(pExpected->size(), mem.size());
+  ASSERT_EQ(0, memcmp(pExpected->data(), mem.data(), mem.size()));
+
+  delete pEnc;
+  delete pExpected;
+}
+
+/*
+ * Sink that is always backed up.
+ */
+class StalledSink : public crow::MemorySink {
+public:
+  StalledSink() : crow::MemorySink(), numWrites(0), maxWrite(0) {}
+  int write(const struct iovec *iov, int iovcnt) override {
+    size_t len = 0;
+    for (int i=0; i < iovcnt; i++) { len += iov[i].iov_len; }
+    numWrites++;
+    maxWrite = std::max(maxWrite, len);
+    return crow::MemorySink::write(iov, iovcnt);
+  }
+  bool ready() const override { return false; }
+  int numWrites;
+  size_t maxWrite;
+};
+
+TEST_F(SinkTest, maxBufferedBytes)
+{
+  auto pEnc = crow::EncoderFactory::New();
+  auto pExpected = crow::EncoderFactory::New();
+  StalledSink sink;
+
+  // buffered output stays bounded while sink is not ready
+  pEnc->setFlushPolicy(crow::FlushPolicy(1, 0, 0, 512));
+  encodeRows(*pEnc, 2000, &sink);
+  pEnc->sync(sink);
+
+  ASSERT_TRUE(sink.numWrites > 10);
+  ASSERT_TRUE(sink.maxWrite < 512 + 64);
+
+  encodeRows(*pExpected, 2000, nullptr);
+  pExpected->flush();
+  ASSERT_EQ(pExpected->size(), sink.size());
+  ASSERT_EQ(0, memcmp(pExpected->data(), sink.data(), sink.size()));
+
+  delete pEnc;
+  delete pExpected;
+}
+
+TEST_F(SinkTest, shardedEncoder)
+{
+  static const int NUM_THREADS = 4;
+  static const int NUM_ROWS = 3000;
+  static const SPFieldDef fshard = FieldDef::alloc(TINT32, "shard");
+
+  crow::MemorySink mem;
+  {
+    crow::ShardedEncoder sharded(mem, crow::BlockPolicy(0, 1024));
+    std::vector<std::thread> threads;
+    for (int t=0; t < NUM_THREADS; t++) {
+      threads.push_back(std::thread([&sharded, t]() {
+        crow::Encoder *enc = sharded.newShard();
+        for (int i=0; i < NUM_ROWS; i++) {
+          enc->put(fshard, t);
+          enc->put(fage, i);
+          enc->endRow(sharded.sink());
+        }
+      }));
+    }
+    for (auto &th : threads) { th.join(); }
+    sharded.close();
+    ASSERT_EQ(NUM_THREADS, sharded.numShards());
+    ASSERT_EQ(0, sharded.getErrCode());
+  }
+
+  // rows of each shard arrive complete and in order
+
+  auto dl = crow::GenericDecoderListener();
+  auto pDec = crow::DecoderFactory::New(mem.data(), mem.size());
+  ASSERT_EQ(NUM_THREADS * NUM_ROWS, pDec->decode(dl));
+  ASSERT_EQ(NUM_THREADS * NUM_ROWS, dl._rows.size());
+
+  std::vector<int> nextAge(NUM_THREADS, 0);
+  for (auto &row : dl._rows) {
+    int shard = -1, age = -1;
+    for (auto &it : row) {
+      if (it.first->name == "shard") { shard = it.second.as_i32(); }
+      if (it.first->name == "age") { age = it.second.as_i32(); }
+    }
+    ASSERT_TRUE(shard >= 0 && shard < NUM_THREADS);
+    ASSERT_EQ(nextAge[shard]++, age);
+  }
+  delete pDec;
+}
+
+TEST_F(SinkTest, flushfdZeroKeepsOutput)
+{
+  auto pEnc = crow::EncoderFactory::New();
+  auto pExpected = crow::EncoderFactory::New();
+  encodeRows(*pEnc, 3, nullptr);
+  encodeRows(*pExpected, 3, nullptr);
+
+  // no fd: output stays in encoder, as with flush()
+  pEnc->flushfd(0);
+  pExpected->flush();
+  ASSERT_TRUE(pEnc->size() > 0);
+  ASSERT_EQ(pExpected->size(), pEnc->size());
+  ASSERT_EQ(0, memcmp(pExpected->data(), pEnc->data(), pEnc->size()));
+
+  delete pEnc;
+  delete pExpected;
+}
@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include "../include/crow.hpp"
+#include "test_defs.hpp"
+
+class StackTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+
+  }
+};
+
+// grows through arena, heap and mmap'd buffers, keeping contents
+TEST_F(StackTest, growKeepsContents)
+{
+  crow::Stack stack(64);
+  const size_t total = 8 * 1024 * 1024;
+
+  for (size_t i=0; i < total; i += 4) {
+    uint32_t val = (uint32_t)i;
+    memcpy(stack.Push(sizeof(val)), &val, sizeof(val));
+  }
+
+  ASSERT_EQ(total, stack.GetSize());
+  ASSERT_TRUE(stack.GetCapacity() >= total);
+
+  const uint8_t *p = stack.Bottom();
+  for (size_t i=0; i < total; i += 4) {
+    uint32_t val;
+    memcpy(&val, p + i, sizeof(val));
+    ASSERT_EQ((uint32_t)i, val);
+  }
+}
+
+// capacity is trimmed back after a spike
+TEST_F(StackTest, trimAfterSpike)
+{
+  crow::Stack stack(4096);
+
+  stack.Push(4 * 1024 * 1024);
+  stack.Clear();
+  size_t spikeCapacity = stack.GetCapacity();
+
+  for (int i=0; i < 200; i++) {
+    memset(stack.Push(1000), 0x5a, 1000);
+    stack.Clear();
+  }
+
+  ASSERT_TRUE(stack.GetCapacity() < spikeCapacity);
+  ASSERT_TRUE(stack.GetCapacity() >= 1000);
+}
+
+TEST_F(StackTest, swap)
+{
+  crow::Stack a(16), b(16);
+  memcpy(a.Push(3), "abc", 3);
+  memcpy(b.Push(2), "xy", 2);
+
+  a.Swap(b);
+
+  ASSERT_EQ(2, a.GetSize());
+  ASSERT_EQ(0, memcmp(a.Bottom(), "xy", 2));
+  ASSERT_EQ(3, b.GetSize());
+  ASSERT_EQ(0, memcmp(b.Bottom(), "abc", 3));
+}
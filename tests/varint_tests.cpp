@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include <random>
+#include "../include/crow.hpp"
+#include "test_defs.hpp"
+
+class VarIntTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+
+  }
+};
+
+static std::vector<uint64_t> testValues()
+{
+  std::vector<uint64_t> values;
+  for (int shift = 0; shift < 64; shift++) {
+    uint64_t v = 1ULL << shift;
+    values.push_back(v - 1);
+    values.push_back(v);
+    values.push_back(v + 1);
+  }
+  values.push_back(~0ULL);
+  std::mt19937_64 rng(1234);
+  for (int i=0; i < 10000; i++) {
+    values.push_back(rng() >> (rng() % 64));
+  }
+  return values;
+}
+
+TEST_F(VarIntTest, kernelsMatchScalar)
+{
+  uint8_t expected[16], actual[16];
+
+  for (uint64_t value : testValues()) {
+    size_t len = crow::encodeVarIntScalar(value, expected);
+    ASSERT_EQ(len, crow::varIntSize(value));
+
+    memset(actual, 0, sizeof(actual));
+    ASSERT_EQ(len, crow::encodeVarInt(value, actual));
+    ASSERT_EQ(0, memcmp(expected, actual, len));
+
+#if CROW_VARINT_X86
+    if (__builtin_cpu_supports("bmi2")) {
+      memset(actual, 0, sizeof(actual));
+      ASSERT_EQ(len, crow::encodeVarIntPdep(value, actual));
+      ASSERT_EQ(0, memcmp(expected, actual, len));
+    }
+#endif
+  }
+}
+
+TEST_F(VarIntTest, encoderUint32)
+{
+  static const SPFieldDef U32 = FieldDef::alloc(TUINT32, 5);
+
+  auto pEnc = crow::EncoderFactory::New();
+  auto &enc = *pEnc;
+
+  std::string s = "";
+
+  enc.put(U32, 300U);          s += "03000305";
+  s += "05";                   s += "80ac02";
+  enc.startRow();              s += "05";
+  enc.put(U32, 0xFFFFFFFFU);   s += "80ffffffff0f";
+
+  const uint8_t* result = enc.data();
+
+  std::string actual;
+  BytesToHexString(result, enc.size(), actual);
+
+  ASSERT_EQ(s, actual);
+
+  delete pEnc;
+}
+
+TEST_F(VarIntTest, decodeKernelsMatch)
+{
+  uint8_t buf[32];
+
+  for (uint64_t value : testValues()) {
+    memset(buf, 0, sizeof(buf));
+    size_t len = crow::encodeVarIntScalar(value, buf);
+    uint64_t actual = 0;
+
+    ASSERT_EQ(len, crow::decodeVarIntScalar(buf, actual));
+    ASSERT_EQ(value, actual);
+
+    actual = 0;
+    ASSERT_EQ(len, crow::decodeVarIntFast(buf, actual));
+    ASSERT_EQ(value, actual);
+
+#if CROW_VARINT_X86
+    if (__builtin_cpu_supports("bmi2")) {
+      actual = 0;
+      ASSERT_EQ(len, crow::decodeVarIntPext(buf, actual));
+      ASSERT_EQ(value, actual);
+    }
+#endif
+  }
+}
+
+class SumListener : public crow::DecoderListener {
+public:
+  SumListener() : sum(0), count(0) {}
+  void onField(crow::SPCFieldInfo, uint32_t value, uint8_t flags) override { sum += value; count++; }
+  void onField(crow::SPCFieldInfo, int32_t value, uint8_t flags) override { sum += value; count++; }
+  int64_t sum;
+  size_t count;
+};
+
+// values near end of buffer use the bounds checked loop
+TEST_F(VarIntTest, decoderRoundTrip)
+{
+  static const SPFieldDef U32 = FieldDef::alloc(TUINT32, 1);
+  static const SPFieldDef I32 = FieldDef::alloc(TINT32, 2);
+
+  auto pEnc = crow::EncoderFactory::New();
+  auto &enc = *pEnc;
+
+  std::mt19937 rng(99);
+  int64_t expected = 0;
+  for (int i=0; i < 1000; i++) {
+    uint32_t u = rng() >> (rng() % 32);
+    int32_t s = (int32_t)(rng() >> (rng() % 32)) - 40000;
+    enc.put(U32, u);
+    enc.put(I32, s);
+    enc.startRow();
+    expected += (int64_t)u + s;
+  }
+
+  const uint8_t* result = enc.data();
+
+  SumListener listener;
+  auto pDec = crow::DecoderFactory::New(result, enc.size());
+  pDec->decode(listener);
+
+  ASSERT_EQ(2000, listener.count);
+  ASSERT_EQ(expected, listener.sum);
+
+  delete pDec;
+  delete pEnc;
+}